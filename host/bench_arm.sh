@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# Instruction counts of MODFX_PROCESS for the Cortex-M4 build of tommy_bench,
+# run under qemu user mode with the TCG instruction counting plugin.
+#
+#   bench_arm.sh <tommy_bench binary>
+#
+# or through make, which builds the binary first:
+#
+#   make bench-arm QEMU_PLUGIN=/path/to/libinsn.so
+#
+# Each scenario runs twice, with and without MODFX_PROCESS, and the
+# difference is the unit's own cost: the glibc start-up of the static Linux
+# build, the harness and the oscillator are counted in both runs. Cycles are
+# an estimate: instructions times ARM_CPI, which covers flash/SDRAM wait
+# states and pipeline refills on the device.
+#
+# Environment:
+#   ARM_CXX       compiler make builds the binary with
+#                 (default arm-linux-gnueabihf-g++)
+#   QEMU          qemu-arm binary (default qemu-arm)
+#   QEMU_PLUGIN   path to libinsn.so from the qemu build (required)
+#   BLOCKS        measured blocks per scenario (default 500)
+#   FRAMES        block size in frames (default 64)
+#   ARM_CPI       cycles per instruction estimate (default 1.3)
+#   CPU_HZ        core clock (default 180000000, STM32F446)
+#
+
+BENCH=$1
+QEMU=${QEMU:-qemu-arm}
+BLOCKS=${BLOCKS:-500}
+FRAMES=${FRAMES:-64}
+ARM_CPI=${ARM_CPI:-1.3}
+CPU_HZ=${CPU_HZ:-180000000}
+
+if [ -z "$BENCH" ] || [ -z "$QEMU_PLUGIN" ]; then
+  echo "usage: QEMU_PLUGIN=/path/to/libinsn.so $0 <tommy_bench>" >&2
+  exit 1
+fi
+
+LOG=$(mktemp)
+trap 'rm -f "$LOG"' EXIT
+
+# Prints the instruction count reported by the plugin for one run
+count() {
+  "$QEMU" -plugin "$QEMU_PLUGIN" -d plugin -D "$LOG" "$BENCH" -n "$BLOCKS" -b "$FRAMES" "$@" > /dev/null || exit 1
+  grep insns "$LOG" | grep -o '[0-9][0-9]*' | tail -n 1
+}
+
+for SCENARIO in $("$QEMU" "$BENCH" --list); do
+  VARIANT=$("$QEMU" "$BENCH" -s "$SCENARIO" -n 1 -b "$FRAMES" | sed 's/.*"variant":"\([^"]*\)".*/\1/')
+  WITH=$(count -s "$SCENARIO")
+  WITHOUT=$(count -s "$SCENARIO" --no-modfx)
+
+  awk -v v="$VARIANT" -v s="$SCENARIO" -v w="$WITH" -v wo="$WITHOUT" \
+      -v n="$BLOCKS" -v f="$FRAMES" -v cpi="$ARM_CPI" -v hz="$CPU_HZ" 'BEGIN {
+    insns = (w - wo) / n;
+    cycles = insns * cpi;
+    budget = hz * f / 48000;
+    printf("{\"variant\":\"%s\",\"scenario\":\"%s\",\"frames_per_block\":%d,\"blocks\":%d,", v, s, f, n);
+    printf("\"insns_per_block\":%.1f,\"insns_per_frame\":%.2f,", insns, insns / f);
+    printf("\"est_cycles_per_block\":%.1f,\"est_cycles_per_frame\":%.2f,", cycles, cycles / f);
+    printf("\"budget_cycles_per_block\":%.1f,\"budget_pct\":%.3f}\n", budget, 100 * cycles / budget);
+  }'
+done
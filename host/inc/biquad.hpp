@@ -0,0 +1,124 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//*/
+
+/*
+ *  File: biquad.hpp
+ *
+ *  Host stand-in for the logue-sdk biquad filter (transposed direct form II).
+ */
+
+#ifndef __biquad_hpp
+#define __biquad_hpp
+
+#include "float_math.h"
+
+namespace dsp {
+
+  struct BiQuad {
+
+    struct Coeffs {
+      float ff0, ff1, ff2, fb1, fb2;
+
+      Coeffs(void) :
+        ff0(0), ff1(0), ff2(0), fb1(0), fb2(0)
+      { }
+
+      static inline float wc(const float fc, const float fsrecip) {
+        return fc * fsrecip;
+      }
+
+      inline void setFOLP(const float k) {
+        const float kp1 = k + 1.f;
+        ff0 = k / kp1;
+        ff1 = ff0;
+        ff2 = 0;
+        fb1 = (k - 1.f) / kp1;
+        fb2 = 0;
+      }
+
+      inline void setFOHP(const float k) {
+        const float kp1 = k + 1.f;
+        ff0 = 1.f / kp1;
+        ff1 = -ff0;
+        ff2 = 0;
+        fb1 = (k - 1.f) / kp1;
+        fb2 = 0;
+      }
+
+      inline void setSOLP(const float k, const float q) {
+        const float qk2 = q * k * k;
+        const float kq = k + q + qk2;
+        const float kq_recip = 1.f / kq;
+        ff0 = qk2 * kq_recip;
+        ff1 = 2.f * ff0;
+        ff2 = ff0;
+        fb1 = 2.f * (qk2 - q) * kq_recip;
+        fb2 = (qk2 - k + q) * kq_recip;
+      }
+    };
+
+    BiQuad(void) :
+      mZ1(0), mZ2(0)
+    { }
+
+    inline void flush(void) {
+      mZ1 = mZ2 = 0;
+    }
+
+    inline float process_fo(const float xn) {
+      const float acc = mCoeffs.ff0 * xn + mZ1;
+      mZ1 = mCoeffs.ff1 * xn;
+      mZ1 -= mCoeffs.fb1 * acc;
+      return acc;
+    }
+
+    inline float process_so(const float xn) {
+      const float acc = mCoeffs.ff0 * xn + mZ1;
+      mZ1 = mCoeffs.ff1 * xn + mZ2;
+      mZ2 = mCoeffs.ff2 * xn;
+      mZ1 -= mCoeffs.fb1 * acc;
+      mZ2 -= mCoeffs.fb2 * acc;
+      return acc;
+    }
+
+    inline float process(const float xn) {
+      return process_so(xn);
+    }
+
+    Coeffs mCoeffs;
+    float mZ1, mZ2;
+  };
+
+}
+
+#endif // __biquad_hpp
@@ -0,0 +1,68 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//*/
+
+/*
+ *  File: fixed_math.h
+ *
+ *  Host stand-in for the logue-sdk fixed point helpers.
+ */
+
+#ifndef __fixed_math_h
+#define __fixed_math_h
+
+#include <stdint.h>
+
+typedef int32_t q31_t;
+typedef int16_t q15_t;
+
+#define q31_to_f32_c 4.65661287307739e-010f
+
+static inline __attribute__((always_inline))
+float q31_to_f32(q31_t q) {
+  return (float)q * q31_to_f32_c;
+}
+
+/* Saturates like the Cortex-M4 VCVT does, x86 would wrap f32_to_q31(1) to -1. */
+static inline __attribute__((always_inline))
+q31_t f32_to_q31(float f) {
+  const float s = f * (float)0x7FFFFFFF;
+  if (s >= 2147483647.f) {
+    return 0x7FFFFFFF;
+  }
+  if (s <= -2147483648.f) {
+    return (q31_t)0x80000000;
+  }
+  return (q31_t)s;
+}
+
+#endif // __fixed_math_h
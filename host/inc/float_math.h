@@ -0,0 +1,103 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//*/
+
+/*
+ *  File: float_math.h
+ *
+ *  Host stand-in for the logue-sdk floating point helpers.
+ */
+
+#ifndef __float_math_h
+#define __float_math_h
+
+#include <stdint.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define fasti __attribute__((always_inline)) static inline
+
+typedef union {
+  float f;
+  uint32_t i;
+} f32_t;
+
+fasti float si_fabsf(float x) {
+  return fabsf(x);
+}
+
+fasti float si_floorf(float x) {
+  return floorf(x);
+}
+
+fasti float si_roundf(float x) {
+  return roundf(x);
+}
+
+fasti float si_fmaxf(float x, float y) {
+  return (x > y) ? x : y;
+}
+
+fasti float si_fminf(float x, float y) {
+  return (x < y) ? x : y;
+}
+
+fasti float clipmaxf(const float x, const float m) {
+  return (x > m) ? m : x;
+}
+
+fasti float clipminf(const float m, const float x) {
+  return (x < m) ? m : x;
+}
+
+fasti float clipminmaxf(const float min, const float x, const float max) {
+  return (x >= max) ? max : (x <= min) ? min : x;
+}
+
+fasti float clip01f(const float x) {
+  return clipminmaxf(0.f, x, 1.f);
+}
+
+fasti float clip1m1f(const float x) {
+  return clipminmaxf(-1.f, x, 1.f);
+}
+
+fasti float linintf(const float fr, const float x0, const float x1) {
+  return x0 + fr * (x1 - x0);
+}
+
+#undef fasti
+
+#endif // __float_math_h
@@ -0,0 +1,67 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//*/
+
+/*
+ *  File: osc_api.h
+ *
+ *  Host stand-in for the logue-sdk oscillator runtime API.
+ */
+
+#ifndef __osc_api_h
+#define __osc_api_h
+
+#include <stdint.h>
+
+#include "float_math.h"
+#include "fixed_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define k_midi_to_hz_size 152
+
+/* The device reads midi_to_hz_lut_f, clipped to the table size. */
+static inline __attribute__((always_inline))
+float osc_notehzf(uint8_t note) {
+  if (note >= k_midi_to_hz_size) {
+    note = k_midi_to_hz_size - 1;
+  }
+  return 440.f * powf(2.f, ((float)note - 69.f) / 12.f);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __osc_api_h
@@ -0,0 +1,79 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//*/
+
+/*
+ *  File: usermodfx.h
+ *
+ *  Host stand-in for the logue-sdk modulation effect API.
+ *
+ *  The hooks get unit specific names so that the modfx and the oscillator
+ *  can be linked into the same host executable.
+ */
+
+#ifndef __usermodfx_h
+#define __usermodfx_h
+
+#include <stdint.h>
+
+#include "userprg.h"
+#include "fx_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  k_user_modfx_param_time = 0,
+  k_user_modfx_param_depth,
+  k_num_user_modfx_param_id
+};
+
+void modfx_hook_init(uint32_t platform, uint32_t api);
+void modfx_hook_process(const float *main_xn, float *main_yn,
+                        const float *sub_xn,  float *sub_yn,
+                        uint32_t frames);
+void modfx_hook_suspend(void);
+void modfx_hook_resume(void);
+void modfx_hook_param(uint8_t index, int32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define MODFX_INIT    __attribute__((used)) modfx_hook_init
+#define MODFX_PROCESS __attribute__((used)) modfx_hook_process
+#define MODFX_SUSPEND __attribute__((used)) modfx_hook_suspend
+#define MODFX_RESUME  __attribute__((used)) modfx_hook_resume
+#define MODFX_PARAM   __attribute__((used)) modfx_hook_param
+
+#endif // __usermodfx_h
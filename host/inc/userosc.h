@@ -0,0 +1,95 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//*/
+
+/*
+ *  File: userosc.h
+ *
+ *  Host stand-in for the logue-sdk oscillator API.
+ *
+ *  The hooks get unit specific names so that the oscillator and the modfx
+ *  can be linked into the same host executable.
+ */
+
+#ifndef __userosc_h
+#define __userosc_h
+
+#include <stdint.h>
+
+#include "userprg.h"
+#include "osc_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct user_osc_param {
+  int32_t  shape_lfo;
+  uint16_t pitch;      // note << 8 | fine
+  uint16_t cutoff;
+  uint16_t resonance;
+  uint16_t reserved0[3];
+} user_osc_param_t;
+
+enum {
+  k_user_osc_param_id1 = 0,
+  k_user_osc_param_id2,
+  k_user_osc_param_id3,
+  k_user_osc_param_id4,
+  k_user_osc_param_id5,
+  k_user_osc_param_id6,
+  k_user_osc_param_shape,
+  k_user_osc_param_shiftshape,
+  k_num_user_osc_param_id
+};
+
+void osc_hook_init(uint32_t platform, uint32_t api);
+void osc_hook_cycle(const user_osc_param_t * const params, int32_t *yn, const uint32_t frames);
+void osc_hook_on(const user_osc_param_t * const params);
+void osc_hook_off(const user_osc_param_t * const params);
+void osc_hook_mute(const user_osc_param_t * const params);
+void osc_hook_value(uint16_t value);
+void osc_hook_param(uint16_t index, uint16_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define OSC_INIT    __attribute__((used)) osc_hook_init
+#define OSC_CYCLE   __attribute__((used)) osc_hook_cycle
+#define OSC_NOTEON  __attribute__((used)) osc_hook_on
+#define OSC_NOTEOFF __attribute__((used)) osc_hook_off
+#define OSC_MUTE    __attribute__((used)) osc_hook_mute
+#define OSC_VALUE   __attribute__((used)) osc_hook_value
+#define OSC_PARAM   __attribute__((used)) osc_hook_param
+
+#endif // __userosc_h
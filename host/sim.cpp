@@ -0,0 +1,201 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sim.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+static bool eventBefore(const SimEvent &a, const SimEvent &b)
+{
+  return a.frame < b.frame;
+}
+
+bool simParseScript(const char *path, std::vector<SimEvent> &events)
+{
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return false;
+  }
+
+  char line[256];
+  uint32_t lineNum = 0;
+  bool ok = true;
+
+  while (ok && fgets(line, sizeof(line), f)) {
+    lineNum++;
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = 0;
+    }
+
+    float seconds, value = 0;
+    char cmd[16];
+    int fields = sscanf(line, "%f %15s %f", &seconds, cmd, &value);
+    if (fields <= 0) {
+      continue;
+    }
+
+    SimEvent e;
+    memset(&e, 0, sizeof(e));
+    e.frame = (uint32_t)(seconds * SIM_SAMPLERATE + 0.5f);
+
+    if (fields >= 3 && !strcmp(cmd, "note")) {
+      int note, fine = 0;
+      sscanf(line, "%*f %*s %d %d", &note, &fine);
+      e.type = k_sim_event_note;
+      e.pitch = (uint16_t)(((note & 0x7f) << 8) | (fine & 0xff));
+    } else if (fields >= 2 && !strcmp(cmd, "off")) {
+      int note, fine = 0;
+      e.type = k_sim_event_off;
+      if (sscanf(line, "%*f %*s %d %d", &note, &fine) >= 1) {
+        e.pitch = (uint16_t)(((note & 0x7f) << 8) | (fine & 0xff));
+      } else {
+        e.pitch = SIM_PITCH_LAST;
+      }
+    } else if (fields >= 3 && !strcmp(cmd, "time")) {
+      e.type = k_sim_event_param;
+      e.index = k_user_modfx_param_time;
+      e.value = value;
+    } else if (fields >= 3 && !strcmp(cmd, "depth")) {
+      e.type = k_sim_event_param;
+      e.index = k_user_modfx_param_depth;
+      e.value = value;
+    } else {
+      fprintf(stderr, "%s:%u: unrecognized event\n", path, lineNum);
+      ok = false;
+    }
+    events.push_back(e);
+  }
+  fclose(f);
+
+  std::stable_sort(events.begin(), events.end(), eventBefore);
+  return ok;
+}
+
+void Sim::init(const SimHooks &hooks)
+{
+  mHooks = &hooks;
+  mPitch = 60 << 8;
+  mFrames = 0;
+  memset(mSub, 0, sizeof(mSub));
+
+  mHooks->oscInit(0, 0);
+  mHooks->modfxInit(0, 0);
+}
+
+void Sim::noteOn(uint16_t pitch)
+{
+  user_osc_param_t params;
+  memset(&params, 0, sizeof(params));
+  params.pitch = pitch;
+  mPitch = pitch;
+  mHooks->oscOn(&params);
+}
+
+void Sim::noteOff(uint16_t pitch)
+{
+  user_osc_param_t params;
+  memset(&params, 0, sizeof(params));
+  params.pitch = pitch == SIM_PITCH_LAST ? mPitch : pitch;
+  mHooks->oscOff(&params);
+}
+
+void Sim::param(uint8_t index, float value)
+{
+  value = (value < 0.f) ? 0.f : (value > 1.f) ? 1.f : value;
+  mHooks->modfxParam(index, f32_to_q31(value));
+}
+
+void Sim::apply(const SimEvent &e)
+{
+  switch (e.type) {
+    case k_sim_event_note:
+      noteOn(e.pitch);
+      break;
+    case k_sim_event_off:
+      noteOff(e.pitch);
+      break;
+    case k_sim_event_param:
+      param(e.index, e.value);
+      break;
+    default:
+      break;
+  }
+}
+
+void Sim::prepare(const float *audio, uint32_t frames)
+{
+  user_osc_param_t params;
+  memset(&params, 0, sizeof(params));
+  params.pitch = mPitch;
+
+  int32_t osc[SIM_MAXFRAMES];
+  mHooks->oscCycle(&params, osc, frames);
+
+  for (uint32_t i = 0; i < frames; i++) {
+    const float o = q31_to_f32(osc[i]);
+    mXn[i + i] = audio[i] + o;
+    mXn[i + i + 1] = o;
+  }
+  mFrames = frames;
+}
+
+void Sim::processModfx(float *out)
+{
+  // The runtime processes in place, main_yn holds the input on entry.
+  memcpy(out, mXn, mFrames * 2 * sizeof(float));
+  mHooks->modfxProcess(mXn, out, mSub, mSub, mFrames);
+}
+
+void Sim::render(const float *audio, uint32_t frames, const std::vector<SimEvent> &events,
+                 float *out, uint32_t blockFrames,
+                 void (*blockDone)(void *pContext), void *pContext)
+{
+  if (!blockFrames || blockFrames > SIM_MAXFRAMES) {
+    blockFrames = SIM_MAXFRAMES;
+  }
+
+  size_t next = 0;
+  for (uint32_t pos = 0; pos < frames; pos += blockFrames) {
+    while (next < events.size() && events[next].frame <= pos) {
+      apply(events[next++]);
+    }
+    const uint32_t n = std::min(blockFrames, frames - pos);
+    process(&audio[pos], &out[pos * 2], n);
+    if (blockDone) {
+      blockDone(pContext);
+    }
+  }
+}
@@ -0,0 +1,140 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: sim.h
+ *
+ *  Host simulation of the NTS-1 signal chain used by Tommy: the oscillator
+ *  output is summed into both input channels of the modfx, while the
+ *  external audio only arrives on the left channel (the right input is muted).
+ */
+
+#ifndef __sim_h
+#define __sim_h
+
+#include <stdint.h>
+#include <vector>
+
+#include "usermodfx.h"
+#include "userosc.h"
+
+#define SIM_SAMPLERATE 48000
+#define SIM_MAXFRAMES 64 // largest block the runtime hands to the hooks
+#define SIM_PITCH_LAST 0xffff // note off for the last note on
+
+enum {
+  k_sim_event_note = 0,
+  k_sim_event_off,
+  k_sim_event_param
+};
+
+struct SimEvent {
+  uint32_t frame;
+  uint8_t type;
+  uint8_t index;  // modfx param index for k_sim_event_param
+  uint16_t pitch; // note << 8 | fine for k_sim_event_note and k_sim_event_off
+  float value;    // [0, 1] encoder position for k_sim_event_param
+};
+
+// Script lines are "<seconds> note <midi> [fine]", "<seconds> off [<midi> [fine]]",
+// "<seconds> time <0..1>" or "<seconds> depth <0..1>", '#' starts a comment. An off
+// without a note releases the last note on.
+bool simParseScript(const char *path, std::vector<SimEvent> &events);
+
+// The hooks of one copy of the units. The tools run the copy linked in under the
+// hook names, tommy_batch links one copy per worker thread, each with its own
+// globals (see tommy_engine.cpp).
+struct SimHooks {
+  void (*modfxInit)(uint32_t platform, uint32_t api);
+  void (*modfxProcess)(const float *main_xn, float *main_yn, const float *sub_xn, float *sub_yn, uint32_t frames);
+  void (*modfxParam)(uint8_t index, int32_t value);
+  void (*oscInit)(uint32_t platform, uint32_t api);
+  void (*oscCycle)(const user_osc_param_t * const params, int32_t *yn, const uint32_t frames);
+  void (*oscOn)(const user_osc_param_t * const params);
+  void (*oscOff)(const user_osc_param_t * const params);
+};
+
+// A copy of the units linked into tommy_batch, with the bounds of its globals
+// so that they can be saved and put back
+struct SimEngine {
+  SimHooks hooks;
+  char *pData;
+  char *pDataEnd;
+  char *pBss;
+  char *pBssEnd;
+};
+
+#define SIM_UNIT_HOOKS { \
+  modfx_hook_init, modfx_hook_process, modfx_hook_param, \
+  osc_hook_init, osc_hook_cycle, osc_hook_on, osc_hook_off }
+
+static inline const SimHooks &simUnitHooks(void)
+{
+  static const SimHooks hooks = SIM_UNIT_HOOKS;
+  return hooks;
+}
+
+class Sim {
+public:
+  void init(const SimHooks &hooks = simUnitHooks());
+
+  void noteOn(uint16_t pitch);
+  void noteOff(uint16_t pitch = SIM_PITCH_LAST);
+  void param(uint8_t index, float value);
+  void apply(const SimEvent &e);
+
+  // Runs the oscillator and builds the modfx input for the next block.
+  void prepare(const float *audio, uint32_t frames);
+
+  // Runs the modfx on the prepared block, out is interleaved stereo.
+  void processModfx(float *out);
+
+  void process(const float *audio, float *out, uint32_t frames) {
+    prepare(audio, frames);
+    processModfx(out);
+  }
+
+  // Renders a whole mono input, applying events at the block boundaries.
+  // blockDone, if given, is called after each block.
+  void render(const float *audio, uint32_t frames, const std::vector<SimEvent> &events,
+              float *out, uint32_t blockFrames,
+              void (*blockDone)(void *pContext) = 0, void *pContext = 0);
+
+private:
+  const SimHooks *mHooks;
+  uint16_t mPitch;
+  uint32_t mFrames;
+  float mXn[SIM_MAXFRAMES * 2];
+  float mSub[SIM_MAXFRAMES * 2];
+};
+
+#endif // __sim_h
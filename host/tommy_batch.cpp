@@ -0,0 +1,479 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: tommy_batch.cpp
+ *
+ *  Batch renderer for building sample libraries: captures every WAV file
+ *  of a directory with the modfx and plays each of the notes mapped to it,
+ *  one output file per file and note. Each file is captured once, the
+ *  globals of the units are saved at the note and put back for each note
+ *  played. The renders run on a pool of worker threads, each with its own
+ *  copy of the units (see tommy_engine.cpp), that take files from their own
+ *  queue and steal from the others when it runs dry. Inputs and outputs are
+ *  memory mapped.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sim.h"
+#include "wav.h"
+
+// One table per copy of the units linked in, laid out by the linker
+extern const SimEngine * const __start_tommy_engines[];
+extern const SimEngine * const __stop_tommy_engines[];
+
+#define BATCH_NOTETIME 1.f // the capture of a 0.68 s sample at 48k is done by then
+#define BATCH_LENGTH 1.5f
+#define BATCH_SILENCE 1e-4f // a note whose voices stay below this did not sound
+
+struct Input {
+  std::string path;
+  std::string stem;
+  WavMap map;
+  std::vector<uint8_t> notes;
+};
+
+struct Queue {
+  std::mutex lock;
+  std::deque<uint32_t> jobs;
+};
+
+struct Batch {
+  std::vector<Input> inputs;
+  std::vector<uint32_t> jobs; // the inputs with notes
+  std::vector<Queue> queues;
+  std::vector<SimEvent> script;
+  const char *outDir;
+  uint32_t noteFrame;
+  uint32_t frames; // written per note
+  bool pcm16;
+  std::atomic<uint64_t> framesRendered;
+  std::atomic<uint32_t> notes;
+  std::atomic<uint32_t> steals;
+  std::atomic<uint32_t> failures;
+  std::atomic<uint32_t> silent;
+};
+
+// The globals of a copy of the units
+struct EngineState {
+  std::vector<char> data;
+  std::vector<char> bss;
+};
+
+// Capture at 48k in single trigger mode on C4, with a release of about a second
+static void defaultScript(std::vector<SimEvent> &events)
+{
+  SimEvent e;
+  memset(&e, 0, sizeof(e));
+  e.type = k_sim_event_param;
+  e.index = k_user_modfx_param_time;
+  e.value = 0.5f;
+  events.push_back(e);
+  e.index = k_user_modfx_param_depth;
+  e.value = 0.f;
+  events.push_back(e);
+  e.type = k_sim_event_note;
+  e.pitch = 60 << 8;
+  events.push_back(e);
+}
+
+// Lines are "<file.wav> <midi> [<midi> ...]", "*" maps the files not listed.
+// '#' starts a comment.
+static bool parseNoteMap(const char *path, Batch &batch)
+{
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return false;
+  }
+
+  std::vector<uint8_t> others;
+  char line[1024];
+  uint32_t lineNum = 0;
+  bool ok = true;
+
+  while (ok && fgets(line, sizeof(line), f)) {
+    lineNum++;
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = 0;
+    }
+    char *name = strtok(line, " \t\r\n");
+    if (!name) {
+      continue;
+    }
+
+    std::vector<uint8_t> notes;
+    for (char *tok = strtok(0, " \t\r\n"); tok; tok = strtok(0, " \t\r\n")) {
+      notes.push_back((uint8_t)(atoi(tok) & 0x7f));
+    }
+
+    if (!strcmp(name, "*")) {
+      others = notes;
+      continue;
+    }
+    std::vector<Input>::iterator it = batch.inputs.begin();
+    for (; it != batch.inputs.end(); ++it) {
+      if (!strcmp(strrchr(it->path.c_str(), '/') + 1, name)) {
+        it->notes = notes;
+        break;
+      }
+    }
+    if (it == batch.inputs.end()) {
+      fprintf(stderr, "%s:%u: %s is not in the directory\n", path, lineNum, name);
+      ok = false;
+    }
+  }
+  fclose(f);
+
+  for (size_t k = 0; k < batch.inputs.size(); k++) {
+    if (batch.inputs[k].notes.empty()) {
+      batch.inputs[k].notes = others;
+    }
+  }
+  return ok;
+}
+
+static bool listInputs(const char *dir, Batch &batch)
+{
+  DIR *d = opendir(dir);
+  if (!d) {
+    return false;
+  }
+  for (struct dirent *e = readdir(d); e; e = readdir(d)) {
+    const size_t len = strlen(e->d_name);
+    if (len > 4 && !strcasecmp(e->d_name + len - 4, ".wav")) {
+      Input in;
+      in.path = std::string(dir) + "/" + e->d_name;
+      in.stem = std::string(e->d_name, len - 4);
+      batch.inputs.push_back(in);
+    }
+  }
+  closedir(d);
+
+  // Directory order is arbitrary, the job list should not be
+  std::sort(batch.inputs.begin(), batch.inputs.end(),
+            [](const Input &a, const Input &b) { return a.path < b.path; });
+  return true;
+}
+
+// The next job for worker self: the newest of its own, or else the oldest of another
+static bool takeJob(Batch &batch, uint32_t self, uint32_t &job)
+{
+  const uint32_t count = batch.queues.size();
+  for (uint32_t k = 0; k < count; k++) {
+    Queue &q = batch.queues[(self + k) % count];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.jobs.empty()) {
+      continue;
+    }
+    if (k) {
+      job = q.jobs.front();
+      q.jobs.pop_front();
+      batch.steals++;
+    } else {
+      job = q.jobs.back();
+      q.jobs.pop_back();
+    }
+    return true;
+  }
+  return false;
+}
+
+static void saveState(const SimEngine &engine, EngineState &state)
+{
+  state.data.assign(engine.pData, engine.pDataEnd);
+  state.bss.assign(engine.pBss, engine.pBssEnd);
+}
+
+static void restoreState(const SimEngine &engine, const EngineState &state)
+{
+  std::copy(state.data.begin(), state.data.end(), engine.pData);
+  std::copy(state.bss.begin(), state.bss.end(), engine.pBss);
+}
+
+static bool eventBefore(const SimEvent &a, const SimEvent &b)
+{
+  return a.frame < b.frame;
+}
+
+// Runs the blocks from pos to end, applying the events from next at the block
+// starts. The output from the note frame on is written to out at frame 0, or
+// to lead before the first frame written to out. peak is that of the voices
+// written to out, the right channel of the mono unit carries nothing else (the
+// left one passes the input through while a capture is armed).
+static void run(Batch &batch, Sim &sim, const Input &in, const std::vector<SimEvent> &events, size_t &next,
+                uint32_t pos, uint32_t end, WavMap *pOut, std::vector<float> *pLead, float &peak)
+{
+  float audio[SIM_MAXFRAMES];
+  float yn[SIM_MAXFRAMES * 2];
+  batch.framesRendered += end - pos;
+  for (; pos < end; pos += SIM_MAXFRAMES) {
+    while (next < events.size() && events[next].frame <= pos) {
+      sim.apply(events[next++]);
+    }
+    const uint32_t n = std::min((uint32_t)SIM_MAXFRAMES, end - pos);
+    for (uint32_t i = 0; i < n; i++) {
+      audio[i] = pos + i < in.map.frames ? in.map.sample(pos + i, 0) : 0.f;
+    }
+    sim.process(audio, yn, n);
+    for (uint32_t i = 0; i < n; i++) {
+      if (pos + i < batch.noteFrame) {
+        continue;
+      }
+      if (pLead) {
+        pLead->push_back(yn[i + i]);
+        pLead->push_back(yn[i + i + 1]);
+      } else if (pos + i - batch.noteFrame < batch.frames) {
+        pOut->setSample(pos + i - batch.noteFrame, 0, yn[i + i]);
+        pOut->setSample(pos + i - batch.noteFrame, 1, yn[i + i + 1]);
+        peak = std::max(peak, fabsf(yn[i + i + 1]));
+      }
+    }
+  }
+}
+
+// Captures the input up to the block the notes go in at, then plays each note
+// from there with the globals as they were, writes the frames from the note on
+static void render(Batch &batch, const SimEngine &engine, uint32_t input)
+{
+  const Input &in = batch.inputs[input];
+
+  // The notes are applied at the first block start from the note frame, as the
+  // script events are
+  const uint32_t noteBlock = (batch.noteFrame + SIM_MAXFRAMES - 1) / SIM_MAXFRAMES * SIM_MAXFRAMES;
+  const uint32_t end = batch.noteFrame + batch.frames;
+
+  Sim sim;
+  sim.init(engine.hooks);
+  size_t next = 0;
+  std::vector<float> lead;
+  float peak = 0.f;
+  run(batch, sim, in, batch.script, next, 0, noteBlock, 0, &lead, peak);
+
+  const Sim captured = sim;
+  EngineState state;
+  saveState(engine, state);
+
+  for (size_t n = 0; n < in.notes.size(); n++) {
+    const uint8_t midi = in.notes[n];
+    char name[32];
+    snprintf(name, sizeof(name), "_%u.wav", midi);
+    const std::string outPath = std::string(batch.outDir) + "/" + in.stem + name;
+    WavMap out;
+    if (!wavMapCreate(outPath.c_str(), out, batch.frames, 2, SIM_SAMPLERATE, batch.pcm16)) {
+      fprintf(stderr, "%s: could not write WAV file\n", outPath.c_str());
+      batch.failures++;
+      continue;
+    }
+
+    // The script events still to come, with the note after those of its frame
+    std::vector<SimEvent> events(batch.script.begin() + next, batch.script.end());
+    SimEvent note;
+    memset(&note, 0, sizeof(note));
+    note.frame = batch.noteFrame;
+    note.type = k_sim_event_note;
+    note.pitch = (uint16_t)(midi << 8);
+    events.insert(std::upper_bound(events.begin(), events.end(), note, eventBefore), note);
+
+    if (n) {
+      restoreState(engine, state);
+      sim = captured;
+    }
+    const uint32_t leadFrames = std::min((uint32_t)lead.size() / 2, batch.frames);
+    for (uint32_t i = 0; i < leadFrames; i++) {
+      out.setSample(i, 0, lead[i + i]);
+      out.setSample(i, 1, lead[i + i + 1]);
+    }
+    peak = 0.f;
+    size_t noteNext = 0;
+    run(batch, sim, in, events, noteNext, noteBlock, std::max(end, noteBlock), &out, 0, peak);
+    wavUnmap(out);
+    batch.notes++;
+
+    if (peak < BATCH_SILENCE && end > noteBlock) {
+      fprintf(stderr, "%s: warning, the note is silent, the capture was not done at %.2f s (see -t) or it is silent\n",
+              outPath.c_str(), (double)batch.noteFrame / SIM_SAMPLERATE);
+      batch.silent++;
+    }
+  }
+}
+
+static void worker(Batch *pBatch, uint32_t self)
+{
+  const SimEngine &engine = *__start_tommy_engines[self];
+  uint32_t job;
+  while (takeJob(*pBatch, self, job)) {
+    render(*pBatch, engine, pBatch->jobs[job]);
+  }
+}
+
+static void usage(uint32_t engines)
+{
+  fprintf(stderr,
+    "usage: tommy_batch -d dir -m notes.txt -o outdir [-s script.txt] [-t seconds] [-l seconds] [-j threads] [-16]\n"
+    "  -d   directory of WAV files, channel 0 feeds the left input\n"
+    "  -m   note map, lines of \"<file.wav> <midi> [<midi> ...]\", \"*\" for the other files\n"
+    "  -o   output directory, one <file>_<midi>.wav per file and note\n"
+    "  -s   capture script, as for tommy_render (default: single trigger at 48k on C4)\n"
+    "  -t   when the mapped note is played, in seconds (default %.1f)\n"
+    "  -l   length written from the note on, in seconds (default %.1f)\n"
+    "  -j   worker threads (default: the cores, at most %u)\n"
+    "  -16  write 16-bit PCM instead of 32-bit float\n",
+    BATCH_NOTETIME, BATCH_LENGTH, engines);
+}
+
+int main(int argc, char **argv)
+{
+  const uint32_t engines = __stop_tommy_engines - __start_tommy_engines;
+  const char *dir = 0, *mapPath = 0, *scriptPath = 0;
+  float noteTime = BATCH_NOTETIME, seconds = BATCH_LENGTH;
+  uint32_t threads = std::thread::hardware_concurrency();
+
+  Batch batch;
+  batch.outDir = 0;
+  batch.pcm16 = false;
+  batch.framesRendered = 0;
+  batch.notes = 0;
+  batch.steals = 0;
+  batch.failures = 0;
+  batch.silent = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+      dir = argv[++i];
+    } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+      mapPath = argv[++i];
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      batch.outDir = argv[++i];
+    } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      scriptPath = argv[++i];
+    } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      noteTime = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-16")) {
+      batch.pcm16 = true;
+    } else {
+      usage(engines);
+      return 1;
+    }
+  }
+
+  if (!dir || !mapPath || !batch.outDir || noteTime < 0 || seconds <= 0) {
+    usage(engines);
+    return 1;
+  }
+  if (!threads || threads > engines) {
+    threads = engines;
+  }
+  batch.noteFrame = (uint32_t)(noteTime * SIM_SAMPLERATE);
+  batch.frames = (uint32_t)(seconds * SIM_SAMPLERATE);
+
+  if (!listInputs(dir, batch)) {
+    fprintf(stderr, "%s: could not read directory\n", dir);
+    return 1;
+  }
+  if (!parseNoteMap(mapPath, batch)) {
+    fprintf(stderr, "%s: could not read note map\n", mapPath);
+    return 1;
+  }
+  if (scriptPath) {
+    if (!simParseScript(scriptPath, batch.script)) {
+      fprintf(stderr, "%s: could not read script\n", scriptPath);
+      return 1;
+    }
+  } else {
+    defaultScript(batch.script);
+  }
+  mkdir(batch.outDir, 0755);
+
+  for (uint32_t k = 0; k < batch.inputs.size(); k++) {
+    Input &in = batch.inputs[k];
+    if (in.notes.empty()) {
+      continue;
+    }
+    if (!wavMapRead(in.path.c_str(), in.map)) {
+      fprintf(stderr, "%s: unsupported or unreadable WAV file\n", in.path.c_str());
+      return 1;
+    }
+    if (in.map.sampleRate != SIM_SAMPLERATE) {
+      fprintf(stderr, "%s: warning, %u Hz input is processed as %d Hz\n", in.path.c_str(), in.map.sampleRate, SIM_SAMPLERATE);
+    }
+    batch.jobs.push_back(k);
+  }
+
+  // Dealt round the workers, the stealing evens out the lengths
+  std::vector<Queue> queues(threads);
+  batch.queues.swap(queues);
+  for (uint32_t j = 0; j < batch.jobs.size(); j++) {
+    batch.queues[j % threads].jobs.push_back(j);
+  }
+
+  const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (uint32_t w = 0; w < threads; w++) {
+    pool.push_back(std::thread(worker, &batch, w));
+  }
+  for (uint32_t w = 0; w < threads; w++) {
+    pool[w].join();
+  }
+  const std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+  for (size_t k = 0; k < batch.inputs.size(); k++) {
+    wavUnmap(batch.inputs[k].map);
+  }
+
+  const double wall = std::chrono::duration<double>(t1 - t0).count();
+  const double audioSeconds = (double)batch.framesRendered / SIM_SAMPLERATE;
+  printf("{\"jobs\":%u,\"notes\":%u,\"failed\":%u,\"silent\":%u,\"threads\":%u,\"steals\":%u,"
+         "\"audio_seconds\":%.2f,\"wall_seconds\":%.3f,\"realtime\":%.1f}\n",
+         (uint32_t)batch.jobs.size(), (uint32_t)batch.notes, (uint32_t)batch.failures, (uint32_t)batch.silent,
+         threads, (uint32_t)batch.steals,
+         audioSeconds, wall, wall > 0 ? audioSeconds / wall : 0.0);
+  return batch.failures ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: tommy_bench.cpp
+ *
+ *  Per-block cost of MODFX_PROCESS for a set of scripted scenarios.
+ *  Prints one JSON object per scenario (JSON Lines).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+#include "sim.h"
+#include "usermodfx.h"
+
+#ifndef TOMMY_VARIANT
+#define TOMMY_VARIANT "unknown"
+#endif
+
+#define BENCH_BLOCKS 3000
+#define BENCH_WARMUP_MAX 30 // seconds, a capture at 4k takes about 8
+#define BENCH_NOTE_ROOT (69 << 8)
+
+// B encoder position for the re-trigger mode at a given sample rate
+#define RETRIG_DEPTH(rate) (0.5f + 0.5f * ((rate) - (48000.f - 44100.f)) / 44100.f)
+
+struct Scenario {
+  const char *name;
+  float depth;          // B encoder, 0.5 leaves sampling off
+  uint32_t warmup;      // blocks run before measuring, at least
+  bool untilPlaying;    // and on until the first capture plays, for re-trigger mode
+  void (*drive)(Sim &sim, uint32_t block);
+};
+
+static void driveIdle(Sim &sim, uint32_t block)
+{
+  (void)sim;
+  (void)block;
+}
+
+// Single trigger capture through the filter, re-armed once the buffer is full
+static void driveCapture(Sim &sim, uint32_t block)
+{
+  if (block % 600 == 0) {
+    sim.param(k_user_modfx_param_depth, 0.f);
+    sim.noteOn(BENCH_NOTE_ROOT);
+  }
+}
+
+// One captured buffer, then a single voice that is never overlapped
+static void driveSingleVoice(Sim &sim, uint32_t block)
+{
+  if (block == 0) {
+    sim.param(k_user_modfx_param_depth, 0.f);
+    sim.noteOn(BENCH_NOTE_ROOT);
+  } else if (block % 520 == 0) {
+    sim.noteOn((72 << 8));
+  }
+}
+
+// Re-trigger mode with a note every 4 blocks: every voice active, the
+// crossfade running and the recorder restarted on each root note.
+static void driveStorm(Sim &sim, uint32_t block)
+{
+  static const uint16_t notes[] = { BENCH_NOTE_ROOT, (76 << 8), (81 << 8), (88 << 8), (64 << 8) };
+  if (block % 4 == 0) {
+    sim.noteOn(notes[(block / 4) % (sizeof(notes) / sizeof(notes[0]))]);
+  }
+}
+
+// The re-trigger scenarios record for longer at the lower rates, each runs on
+// until its first capture plays so that the voices are all going when measured
+static const Scenario scenarios[] = {
+  { "idle",         0.5f,                  0,   false, driveIdle },
+  { "capture",      0.5f,                  0,   false, driveCapture },
+  { "single_voice", 0.5f,                  520, false, driveSingleVoice },
+  { "poly_storm",   RETRIG_DEPTH(48000.f), 600, true,  driveStorm },
+  { "rate_32000",   RETRIG_DEPTH(32000.f), 600, true,  driveStorm },
+  { "rate_24000",   RETRIG_DEPTH(24000.f), 600, true,  driveStorm },
+  { "rate_16000",   RETRIG_DEPTH(16000.f), 600, true,  driveStorm },
+  { "rate_8000",    RETRIG_DEPTH(8000.f),  600, true,  driveStorm },
+  { "rate_4000",    RETRIG_DEPTH(4000.f),  600, true,  driveStorm },
+};
+
+#define NSCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+// Deterministic source: a tremolo sine plus a little noise
+static void fillAudio(float *audio, uint32_t pos, uint32_t frames, uint32_t &seed)
+{
+  for (uint32_t i = 0; i < frames; i++) {
+    const float t = (float)(pos + i) / SIM_SAMPLERATE;
+    seed = seed * 1664525 + 1013904223;
+    const float noise = (float)(seed >> 8) / 16777216.f - 0.5f;
+    audio[i] = 0.5f * sinf(2.f * (float)M_PI * 220.f * t) * (0.6f + 0.4f * sinf(2.f * (float)M_PI * 3.f * t)) + 0.05f * noise;
+  }
+}
+
+static void run(const Scenario &sc, uint32_t blocks, uint32_t frames, bool skipModfx)
+{
+  Sim sim;
+  sim.init();
+  sim.param(k_user_modfx_param_time, 1.f);
+  sim.param(k_user_modfx_param_depth, sc.depth);
+
+  float audio[SIM_MAXFRAMES];
+  float out[SIM_MAXFRAMES * 2];
+
+  uint32_t seed = 0x1234567;
+  uint32_t pos = 0;
+  uint32_t warmup = 0;
+  const uint32_t warmupMax = BENCH_WARMUP_MAX * SIM_SAMPLERATE / frames;
+  bool playing = !sc.untilPlaying;
+  for (; warmup < sc.warmup || (!playing && warmup < warmupMax); warmup++, pos += frames) {
+    sc.drive(sim, warmup);
+    fillAudio(audio, pos, frames, seed);
+    sim.process(audio, out, frames);
+    // Only the voices are heard in re-trigger mode
+    for (uint32_t i = 0; i < frames * 2 && !playing; i++) {
+      playing = out[i] != 0.f;
+    }
+  }
+  if (!playing) {
+    fprintf(stderr, "%s: nothing played after %d s of warmup\n", sc.name, BENCH_WARMUP_MAX);
+  }
+
+  double total = 0, worst = 0;
+  for (uint32_t b = 0; b < blocks; b++, pos += frames) {
+    sc.drive(sim, warmup + b);
+    fillAudio(audio, pos, frames, seed);
+    sim.prepare(audio, frames);
+    if (skipModfx) {
+      continue;
+    }
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    sim.processModfx(out);
+    const std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    total += ns;
+    if (ns > worst) {
+      worst = ns;
+    }
+  }
+
+  const double deadline = 1e9 * frames / SIM_SAMPLERATE;
+  const double avg = blocks ? total / blocks : 0;
+  printf("{\"variant\":\"%s\",\"scenario\":\"%s\",\"frames_per_block\":%u,\"warmup_blocks\":%u,\"blocks\":%u,"
+         "\"ns_per_frame\":%.3f,\"ns_per_block_avg\":%.1f,\"ns_per_block_max\":%.1f,"
+         "\"block_deadline_ns\":%.1f,\"deadline_pct_avg\":%.4f}\n",
+         TOMMY_VARIANT, sc.name, frames, warmup, blocks,
+         avg / frames, avg, worst,
+         deadline, 100.0 * avg / deadline);
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+    "usage: tommy_bench [-s scenario] [-n blocks] [-b frames] [--no-modfx] [--list]\n"
+    "  -s         run a single scenario (default: all)\n"
+    "  -n         measured blocks per scenario (default %d)\n"
+    "  -b         block size in frames (default %d)\n"
+    "  --no-modfx run everything except MODFX_PROCESS, the baseline for instruction counts\n"
+    "  --list     print the scenario names\n",
+    BENCH_BLOCKS, SIM_MAXFRAMES);
+}
+
+int main(int argc, char **argv)
+{
+  const char *only = 0;
+  uint32_t blocks = BENCH_BLOCKS;
+  uint32_t frames = SIM_MAXFRAMES;
+  bool skipModfx = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      only = argv[++i];
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      blocks = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      frames = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--no-modfx")) {
+      skipModfx = true;
+    } else if (!strcmp(argv[i], "--list")) {
+      for (uint32_t s = 0; s < NSCENARIOS; s++) {
+        printf("%s\n", scenarios[s].name);
+      }
+      return 0;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (!frames || frames > SIM_MAXFRAMES) {
+    usage();
+    return 1;
+  }
+
+  bool found = false;
+  for (uint32_t s = 0; s < NSCENARIOS; s++) {
+    if (!only || !strcmp(only, scenarios[s].name)) {
+      run(scenarios[s], blocks, frames, skipModfx);
+      found = true;
+    }
+  }
+
+  if (!found) {
+    fprintf(stderr, "unknown scenario %s\n", only);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: tommy_check.cpp
+ *
+ *  Plays a note script over a steady source and checks that every note
+ *  sounds: the output between a note and the next event must not be silent.
+ *  The notes before the first one that sounds are not checked, they play
+ *  while the first recording is still running.
+ *  Exits with status 1 on the first silent note.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "sim.h"
+
+#ifndef TOMMY_VARIANT
+#define TOMMY_VARIANT "unknown"
+#endif
+
+// Output below this RMS counts as silence
+#define CHECK_SILENCE 0.001f
+
+// Frames skipped after a note, the capture hand-over and the attack
+#define CHECK_SETTLE (SIM_SAMPLERATE / 50)
+
+// Plucks of a 220 Hz sine, so that the recordings end on silence and vary in length
+#define CHECK_PLUCK_PERIOD 0.8f
+#define CHECK_PLUCK_LENGTH 0.4f
+#define CHECK_PLUCK_DECAY 0.1f
+
+static void fillAudio(std::vector<float> &audio)
+{
+  for (uint32_t i = 0; i < audio.size(); i++) {
+    const float t = fmodf((float)i / SIM_SAMPLERATE, CHECK_PLUCK_PERIOD);
+    audio[i] = t < CHECK_PLUCK_LENGTH ? 0.5f * sinf(2.f * (float)M_PI * 220.f * t) * expf(-t / CHECK_PLUCK_DECAY) : 0.f;
+  }
+}
+
+// Of both channels, the ping-pong variant moves the voices from side to side
+static float rms(const std::vector<float> &out, uint32_t start, uint32_t end)
+{
+  double sum = 0;
+  for (uint32_t i = start + start; i < end + end; i++) {
+    sum += (double)out[i] * out[i];
+  }
+  return end > start ? (float)sqrt(sum / (2 * (end - start))) : 0.f;
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+    "usage: tommy_check -s script.txt [-b frames]\n"
+    "  -s   note/param script, see tommy_render\n"
+    "  -b   block size in frames (default %d)\n",
+    SIM_MAXFRAMES);
+}
+
+int main(int argc, char **argv)
+{
+  const char *scriptPath = 0;
+  uint32_t blockFrames = SIM_MAXFRAMES;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      scriptPath = argv[++i];
+    } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      blockFrames = atoi(argv[++i]);
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  if (!scriptPath || !blockFrames || blockFrames > SIM_MAXFRAMES) {
+    usage();
+    return 2;
+  }
+
+  std::vector<SimEvent> events;
+  if (!simParseScript(scriptPath, events) || events.empty()) {
+    fprintf(stderr, "%s: could not read script\n", scriptPath);
+    return 2;
+  }
+
+  const uint32_t frames = events.back().frame + SIM_SAMPLERATE;
+  std::vector<float> audio(frames);
+  fillAudio(audio);
+  std::vector<float> out(frames * 2);
+
+  Sim sim;
+  sim.init();
+  sim.render(audio.data(), frames, events, out.data(), blockFrames);
+
+  uint32_t notes = 0, sounding = 0;
+  for (size_t e = 0; e < events.size(); e++) {
+    if (events[e].type != k_sim_event_note) {
+      continue;
+    }
+    // Events land on block boundaries, the note sounds from there
+    const uint32_t start = (events[e].frame + blockFrames - 1) / blockFrames * blockFrames;
+    const uint32_t end = e + 1 < events.size() ? events[e + 1].frame : frames;
+    const float level = rms(out, std::min(start + CHECK_SETTLE, end), end);
+    if (level >= CHECK_SILENCE) {
+      sounding++;
+    } else if (sounding) {
+      printf("%s %s: note %u at %.3f s is silent (rms %g)\n", TOMMY_VARIANT, scriptPath,
+             notes, (double)events[e].frame / SIM_SAMPLERATE, level);
+      return 1;
+    }
+    notes++;
+  }
+
+  if (!sounding) {
+    printf("%s %s: no note sounds\n", TOMMY_VARIANT, scriptPath);
+    return 1;
+  }
+  printf("%s %s: %u of %u notes sound\n", TOMMY_VARIANT, scriptPath, sounding, notes);
+  return 0;
+}
@@ -0,0 +1,237 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: tommy_kernel.cpp
+ *
+ *  Checks and times the Q15 interpolate-and-mix kernels (modfx/mixq15.h),
+ *  linear, Hermite and sinc, against float versions of the same
+ *  interpolation. The checksums cover the raw mix buffer, a host build and a
+ *  Cortex-M4 build (DSP instructions) must print the same values.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+#include "mixq15.h"
+
+#define KERNEL_BUFLEN 32768
+#define KERNEL_FRAMES 64
+#define KERNEL_SDIV 32767.f
+
+static int16_t store[MIX_TAPSBEFORE + KERNEL_BUFLEN + MIX_TAPSAFTER];
+static int16_t *const buf = &store[MIX_TAPSBEFORE];
+
+static const float steps[] = { 0.25f, 0.5f, 0.7491f, 1.f, 1.4983f, 2.f, 3.7f, 11.3f };
+
+#define NSTEPS (sizeof(steps) / sizeof(steps[0]))
+
+typedef uint32_t (*mixq15_fn)(int32_t *pMix, const int16_t *pBuf, uint32_t phase, uint32_t step,
+                              int32_t gain, int32_t gainInc, uint32_t frames);
+typedef float (*interp_fn)(const int16_t *pBuf, int32_t idx, float fr);
+
+static float linearFloat(const int16_t *pBuf, int32_t idx, float fr)
+{
+  return ((float)pBuf[idx] * (1.f - fr)) + ((float)pBuf[idx + 1] * fr);
+}
+
+static float hermiteFloat(const int16_t *pBuf, int32_t idx, float t)
+{
+  const float xm1 = pBuf[idx - 1], x0 = pBuf[idx], x1 = pBuf[idx + 1], x2 = pBuf[idx + 2];
+  const float c1 = 0.5f * (x1 - xm1);
+  const float c2 = xm1 - 2.5f * x0 + 2.f * x1 - 0.5f * x2;
+  const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+  return x0 + t * (c1 + t * (c2 + t * c3));
+}
+
+static float sincFloat(const int16_t *pBuf, int32_t idx, float fr)
+{
+  const float k = fr * (1 << MIX_SINCPHASEBITS);
+  const uint32_t k0 = (uint32_t)k;
+  float y0 = 0, y1 = 0;
+  for (uint32_t m = 0; m < MIX_SINCTAPS; m++) {
+    const float x = pBuf[idx - MIX_TAPSBEFORE + (int32_t)m];
+    y0 += x * mixSincTable[k0][m];
+    y1 += x * mixSincTable[k0 + 1][m];
+  }
+  return (y0 + (y1 - y0) * (k - (float)k0)) * (1.f / (1 << MIX_COEFBITS));
+}
+
+static const struct {
+  const char *name;
+  mixq15_fn q15;
+  interp_fn interp;
+} kernels[] = {
+  { "linear",  mixQ15,     linearFloat },
+  { "hermite", mixHermite, hermiteFloat },
+  { "sinc",    mixSinc,    sincFloat },
+};
+
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+// Float version of a kernel, the voice loop before the Q15 mix
+static uint32_t mixFloat(interp_fn interp, float *pOut, const int16_t *pBuf, uint32_t phase, uint32_t step,
+                         float gain, float gainInc, uint32_t frames)
+{
+  for (; frames; frames--) {
+    const int32_t idx = phase >> PHASE_FRACBITS;
+    const float fr = (float)(phase & PHASE_FRACMASK) * k_phase_recipf;
+    *pOut += (interp(pBuf, idx, fr) / KERNEL_SDIV) * gain;
+    pOut += 2;
+    phase += step;
+    gain += gainInc;
+  }
+  return phase;
+}
+
+static void fillBuffer(void)
+{
+  uint32_t seed = 0x12345678;
+  for (uint32_t i = 0; i < KERNEL_BUFLEN; i++) {
+    seed = seed * 1664525 + 1013904223;
+    buf[i] = (int16_t)(seed >> 16);
+  }
+}
+
+static uint32_t phaseStep(float step)
+{
+  return (uint32_t)(step * (float)PHASE_ONE + 0.5f);
+}
+
+// Number of blocks before the fastest step runs off the buffer
+static uint32_t blocksPerPass(void)
+{
+  return (KERNEL_BUFLEN - MIX_TAPSAFTER - 1) / (uint32_t)(steps[NSTEPS - 1] * KERNEL_FRAMES + 1);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t passes = 20;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      passes = (uint32_t)atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [-n passes]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  fillBuffer();
+
+  const uint32_t blocks = blocksPerPass();
+  const int32_t gainInc = -(int32_t)(MIX_GAINONE / (blocks * KERNEL_FRAMES));
+  const float gainIncf = (float)gainInc / k_mix_gainf;
+  const float scale = 1.f / ((float)(1L << MIX_SHIFT) * KERNEL_SDIV);
+
+  int32_t mix[KERNEL_FRAMES * 2];
+  float out[KERNEL_FRAMES * 2];
+
+  for (uint32_t kn = 0; kn < NKERNELS; kn++) {
+    const mixq15_fn q15 = kernels[kn].q15;
+    const interp_fn interp = kernels[kn].interp;
+
+    // Bit pattern and accuracy, one pass over every step with a release ramp
+    uint32_t checksum = 2166136261u;
+    float maxErr = 0;
+
+    for (uint32_t s = 0; s < NSTEPS; s++) {
+      const uint32_t step = phaseStep(steps[s]);
+      uint32_t phase = PHASE_ONE / 3;
+      uint32_t phasef = phase;
+      int32_t gain = MIX_GAINONE;
+
+      for (uint32_t b = 0; b < blocks; b++) {
+        memset(mix, 0, sizeof(mix));
+        memset(out, 0, sizeof(out));
+
+        const float gainf = (float)gain / k_mix_gainf;
+        phasef = mixFloat(interp, out, buf, phasef, step, gainf, gainIncf, KERNEL_FRAMES);
+        phase = q15(mix, buf, phase, step, gain, gainInc, KERNEL_FRAMES);
+        gain += gainInc * KERNEL_FRAMES;
+
+        for (uint32_t i = 0; i < KERNEL_FRAMES * 2; i += 2) {
+          const float err = fabsf((float)mix[i] * scale - out[i]);
+          if (err > maxErr) {
+            maxErr = err;
+          }
+          for (uint32_t k = 0; k < 4; k++) {
+            checksum = (checksum ^ (((uint32_t)mix[i] >> (k * 8)) & 0xff)) * 16777619u;
+          }
+        }
+      }
+    }
+
+    // Timing, the same passes with the float loop and the kernel
+    double ns[2];
+    float sink = 0;
+
+    for (uint32_t kernel = 0; kernel < 2; kernel++) {
+      const auto t0 = std::chrono::steady_clock::now();
+
+      for (uint32_t p = 0; p < passes; p++) {
+        for (uint32_t s = 0; s < NSTEPS; s++) {
+          const uint32_t step = phaseStep(steps[s]);
+          uint32_t phase = 0;
+
+          for (uint32_t b = 0; b < blocks; b++) {
+            if (kernel) {
+              phase = q15(mix, buf, phase, step, MIX_GAINONE, gainInc, KERNEL_FRAMES);
+              sink += (float)mix[p & 63];
+            } else {
+              phase = mixFloat(interp, out, buf, phase, step, 1.f, gainIncf, KERNEL_FRAMES);
+              sink += out[p & 63];
+            }
+          }
+        }
+      }
+
+      const auto t1 = std::chrono::steady_clock::now();
+      ns[kernel] = std::chrono::duration<double, std::nano>(t1 - t0).count() / ((double)passes * NSTEPS * blocks * KERNEL_FRAMES);
+    }
+
+    printf("{\"kernel\":\"%s\",\"dsp\":%s,\"checksum\":\"%08x\",\"max_err\":%.3g,"
+           "\"float_ns_per_voice_frame\":%.3f,\"q15_ns_per_voice_frame\":%.3f,\"sink\":%d}\n",
+           kernels[kn].name,
+#if defined(__ARM_FEATURE_DSP)
+           "true",
+#else
+           "false",
+#endif
+           checksum, maxErr, ns[0], ns[1], sink != 0);
+  }
+
+  return 0;
+}
@@ -0,0 +1,242 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: tommy_render.cpp
+ *
+ *  Offline renderer, runs the oscillator and modfx units over a WAV file
+ *  driven by a note/param script.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "sim.h"
+#include "wav.h"
+#include "profile.h"
+
+// Per-block statistics of the modfx, only there when it is built with -DTOMMY_PROFILE
+extern profile_t tommyProfile __attribute__((weak));
+
+struct ProfileDump {
+  FILE *file;
+  uint32_t next; // first block not written yet
+};
+
+// Writes the blocks added to the ring since the last call, one JSON object each
+static void dumpProfile(void *pContext)
+{
+  ProfileDump *pDump = (ProfileDump *)pContext;
+  for (; pDump->next < tommyProfile.count; pDump->next++) {
+    const profile_block_t &b = tommyProfile.blocks[pDump->next & (PROFILE_BLOCKS - 1)];
+    fprintf(pDump->file,
+            "{\"block\":%u,\"frames\":%u,\"ticks\":%u,\"voices\":%u,\"steals\":%u,"
+            "\"notes\":%u,\"captures\":%u,\"job_ticks\":%u,\"job_units\":%u,\"overrun\":%u}\n",
+            pDump->next, b.frames, b.ticks, b.voices, b.steals,
+            b.notes, b.captures, b.jobTicks, b.jobUnits, b.isOverrun);
+  }
+}
+
+// Output below this is silence for the latency
+#define LATENCY_SILENCE 1e-4f
+#define LATENCY_QUIET 64 // silent frames before a note for it to be measured
+#define LATENCY_MAX (SIM_SAMPLERATE / 10) // a note not heard by then started no voice
+
+struct Latency {
+  uint32_t notes;
+  uint32_t maxFrames;
+  uint64_t totalFrames;
+};
+
+static bool isSilent(const float *out, uint32_t start, uint32_t end)
+{
+  for (uint32_t i = start * 2; i < end * 2; i++) {
+    if (out[i] > LATENCY_SILENCE || out[i] < -LATENCY_SILENCE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Frames from each note sent while the output is silent to the first sample of
+// output that is not, before the next event: the wait for the block, the pitch
+// frame, the decoding and the attack, as heard
+static Latency measureLatency(const std::vector<SimEvent> &events, const float *out, uint32_t frames)
+{
+  Latency l = { 0, 0, 0 };
+  for (size_t e = 0; e < events.size(); e++) {
+    const uint32_t from = events[e].frame;
+    if (events[e].type != k_sim_event_note || from < LATENCY_QUIET || from >= frames ||
+        !isSilent(out, from - LATENCY_QUIET, from)) {
+      continue;
+    }
+    uint32_t end = std::min(from + LATENCY_MAX, frames);
+    if (e + 1 < events.size()) {
+      end = std::min(end, events[e + 1].frame);
+    }
+    for (uint32_t i = from; i < end; i++) {
+      if (!isSilent(out, i, i + 1)) {
+        l.notes++;
+        l.totalFrames += i - from;
+        l.maxFrames = std::max(l.maxFrames, i - from);
+        break;
+      }
+    }
+  }
+  return l;
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+    "usage: tommy_render [-i in.wav] [-s script.txt] [-b frames] [-l seconds] [-16] -o out.wav\n"
+    "  -i   external audio, channel 0 feeds the left input (silence if omitted)\n"
+    "  -s   note/param script\n"
+    "  -b   block size in frames (default %d)\n"
+    "  -l   render length in seconds (default: input length)\n"
+    "  -16  write 16-bit PCM instead of 32-bit float\n"
+    "  -p   write the per-block statistics of a -DTOMMY_PROFILE build (JSON Lines)\n",
+    SIM_MAXFRAMES);
+}
+
+int main(int argc, char **argv)
+{
+  const char *inPath = 0, *scriptPath = 0, *outPath = 0, *profilePath = 0;
+  uint32_t blockFrames = SIM_MAXFRAMES;
+  float seconds = -1;
+  bool pcm16 = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+      inPath = argv[++i];
+    } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      scriptPath = argv[++i];
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      outPath = argv[++i];
+    } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      blockFrames = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+      profilePath = argv[++i];
+    } else if (!strcmp(argv[i], "-16")) {
+      pcm16 = true;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (!outPath || !blockFrames || blockFrames > SIM_MAXFRAMES) {
+    usage();
+    return 1;
+  }
+
+  std::vector<float> audio;
+  if (inPath) {
+    WavData in;
+    if (!wavRead(inPath, in)) {
+      fprintf(stderr, "%s: unsupported or unreadable WAV file\n", inPath);
+      return 1;
+    }
+    if (in.sampleRate != SIM_SAMPLERATE) {
+      fprintf(stderr, "%s: warning, %u Hz input is processed as %d Hz\n", inPath, in.sampleRate, SIM_SAMPLERATE);
+    }
+    audio.resize(in.frames());
+    for (uint32_t i = 0; i < in.frames(); i++) {
+      audio[i] = in.samples[i * in.channels];
+    }
+  }
+
+  std::vector<SimEvent> events;
+  if (scriptPath && !simParseScript(scriptPath, events)) {
+    fprintf(stderr, "%s: could not read script\n", scriptPath);
+    return 1;
+  }
+
+  uint32_t frames = audio.size();
+  if (seconds >= 0) {
+    frames = (uint32_t)(seconds * SIM_SAMPLERATE);
+  } else if (!inPath && !events.empty()) {
+    frames = events.back().frame + SIM_SAMPLERATE;
+  }
+  audio.resize(frames, 0.f);
+
+  WavData out;
+  out.sampleRate = SIM_SAMPLERATE;
+  out.channels = 2;
+  out.samples.resize(frames * 2);
+
+  ProfileDump dump = { 0, 0 };
+  if (profilePath) {
+    if (!&tommyProfile) {
+      fprintf(stderr, "%s: the modfx is not built with -DTOMMY_PROFILE\n", profilePath);
+      return 1;
+    }
+    dump.file = fopen(profilePath, "w");
+    if (!dump.file) {
+      fprintf(stderr, "%s: could not open\n", profilePath);
+      return 1;
+    }
+  }
+
+  Sim sim;
+  sim.init();
+  sim.render(audio.data(), frames, events, out.samples.data(), blockFrames,
+             dump.file ? dumpProfile : 0, &dump);
+
+  if (dump.file) {
+    // Totals since init, ticks are DWT cycles on the device and ns on the host.
+    // The latency is measured on the output, for the notes sent in silence.
+    const profile_t &p = tommyProfile;
+    const Latency l = measureLatency(events, out.samples.data(), frames);
+    fprintf(dump.file,
+            "{\"summary\":true,\"blocks\":%u,\"tick_hz\":%u,\"ticks_avg\":%.1f,\"ticks_max\":%u,"
+            "\"overruns\":%u,\"steals\":%u,\"notes\":%u,\"captures\":%u,"
+            "\"job_ticks_per_unit\":%.2f,\"job_ticks_max\":%u,"
+            "\"latency_notes\":%u,\"latency_frames_avg\":%.1f,\"latency_frames_max\":%u}\n",
+            p.count, p.tickHz, p.count ? (double)p.totalTicks / p.count : 0.0, p.maxTicks,
+            p.overruns, p.steals, p.notes, p.captures,
+            p.jobUnits ? (double)p.jobTicks / p.jobUnits : 0.0, p.maxJobTicks,
+            l.notes, l.notes ? (double)l.totalFrames / l.notes : 0.0, l.maxFrames);
+    fclose(dump.file);
+  }
+
+  if (!wavWrite(outPath, out, pcm16)) {
+    fprintf(stderr, "%s: could not write WAV file\n", outPath);
+    return 1;
+  }
+  return 0;
+}
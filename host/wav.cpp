@@ -0,0 +1,288 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "wav.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint32_t readLE(const uint8_t *p, uint8_t bytes)
+{
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < bytes; i++) {
+    v |= (uint32_t)p[i] << (8 * i);
+  }
+  return v;
+}
+
+static void storeLE(uint8_t *p, uint32_t v, uint8_t bytes)
+{
+  for (uint8_t i = 0; i < bytes; i++) {
+    p[i] = (v >> (8 * i)) & 0xff;
+  }
+}
+
+static void writeLE(FILE *f, uint32_t v, uint8_t bytes)
+{
+  for (uint8_t i = 0; i < bytes; i++) {
+    fputc((v >> (8 * i)) & 0xff, f);
+  }
+}
+
+struct WavFormat {
+  uint32_t sampleRate;
+  uint16_t channels;
+  uint16_t format;
+  uint16_t bits;
+  size_t data; // offset of the first frame
+  uint32_t dataLen;
+};
+
+// Finds the format and the samples of a file in memory
+static bool parse(const uint8_t *data, size_t size, WavFormat &fmt)
+{
+  if (size < 12 || memcmp(&data[0], "RIFF", 4) || memcmp(&data[8], "WAVE", 4)) {
+    return false;
+  }
+
+  bool hasFormat = false;
+  size_t pos = 12;
+
+  while (pos + 8 <= size) {
+    const uint32_t chunkLen = readLE(&data[pos + 4], 4);
+    const size_t body = pos + 8;
+    if (body + chunkLen > size) {
+      return false;
+    }
+
+    if (!memcmp(&data[pos], "fmt ", 4) && chunkLen >= 16) {
+      fmt.format = readLE(&data[body], 2);
+      fmt.channels = readLE(&data[body + 2], 2);
+      fmt.sampleRate = readLE(&data[body + 4], 4);
+      fmt.bits = readLE(&data[body + 14], 2);
+      if (fmt.format == 0xfffe && chunkLen >= 26) {
+        // WAVE_FORMAT_EXTENSIBLE, the sub format tag leads the GUID
+        fmt.format = readLE(&data[body + 24], 2);
+      }
+      hasFormat = true;
+
+    } else if (!memcmp(&data[pos], "data", 4) && hasFormat) {
+      const uint8_t bytes = fmt.bits / 8;
+      if (!fmt.channels || !bytes || (fmt.format != 1 && fmt.format != 3) || (fmt.format == 3 && fmt.bits != 32)) {
+        return false;
+      }
+      fmt.data = body;
+      fmt.dataLen = chunkLen;
+      return true;
+    }
+
+    pos = body + chunkLen + (chunkLen & 1);
+  }
+  return false;
+}
+
+static float decode(const uint8_t *p, uint16_t format, uint16_t bits)
+{
+  if (format == 3) {
+    const uint32_t v = readLE(p, 4);
+    float f;
+    memcpy(&f, &v, 4);
+    return f;
+  }
+  // Left align to 32 bits so that the sign bit is correct for every width
+  const int32_t v = (int32_t)(readLE(p, bits / 8) << (32 - bits));
+  return (float)v / 2147483648.f;
+}
+
+// The 44 byte header of a float or 16-bit PCM file
+static void header(uint8_t *p, uint32_t dataLen, uint16_t channels, uint32_t sampleRate, bool pcm16)
+{
+  const uint16_t bits = pcm16 ? 16 : 32;
+  memcpy(p, "RIFF", 4);
+  storeLE(p + 4, 36 + dataLen, 4);
+  memcpy(p + 8, "WAVEfmt ", 8);
+  storeLE(p + 16, 16, 4);
+  storeLE(p + 20, pcm16 ? 1 : 3, 2);
+  storeLE(p + 22, channels, 2);
+  storeLE(p + 24, sampleRate, 4);
+  storeLE(p + 28, sampleRate * channels * (bits / 8), 4);
+  storeLE(p + 32, channels * (bits / 8), 2);
+  storeLE(p + 34, bits, 2);
+  memcpy(p + 36, "data", 4);
+  storeLE(p + 40, dataLen, 4);
+}
+
+bool wavRead(const char *path, WavData &wav)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+
+  std::vector<uint8_t> data;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    data.insert(data.end(), buf, buf + n);
+  }
+  fclose(f);
+
+  WavFormat fmt;
+  if (!parse(data.data(), data.size(), fmt)) {
+    return false;
+  }
+  wav.channels = fmt.channels;
+  wav.sampleRate = fmt.sampleRate;
+
+  const uint8_t bytes = fmt.bits / 8;
+  const size_t count = fmt.dataLen / bytes;
+  wav.samples.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    wav.samples[i] = decode(&data[fmt.data + i * bytes], fmt.format, fmt.bits);
+  }
+  return true;
+}
+
+bool wavWrite(const char *path, const WavData &wav, bool pcm16)
+{
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    return false;
+  }
+
+  const uint32_t dataLen = wav.samples.size() * (pcm16 ? 2 : 4);
+  uint8_t head[44];
+  header(head, dataLen, wav.channels, wav.sampleRate, pcm16);
+  fwrite(head, 1, sizeof(head), f);
+
+  for (size_t i = 0; i < wav.samples.size(); i++) {
+    const float s = wav.samples[i];
+    if (pcm16) {
+      const float c = (s > 1.f) ? 1.f : (s < -1.f) ? -1.f : s;
+      writeLE(f, (uint16_t)(int16_t)(c * 32767.f), 2);
+    } else {
+      uint32_t v;
+      memcpy(&v, &s, 4);
+      writeLE(f, v, 4);
+    }
+  }
+
+  const bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+float WavMap::sample(uint32_t frame, uint16_t channel) const
+{
+  const uint8_t bytes = bits / 8;
+  return decode(&data[((size_t)frame * channels + channel) * bytes], format, bits);
+}
+
+void WavMap::setSample(uint32_t frame, uint16_t channel, float value)
+{
+  uint8_t *p = &data[((size_t)frame * channels + channel) * (bits / 8)];
+  if (format == 1) {
+    const float c = (value > 1.f) ? 1.f : (value < -1.f) ? -1.f : value;
+    storeLE(p, (uint16_t)(int16_t)(c * 32767.f), 2);
+  } else {
+    uint32_t v;
+    memcpy(&v, &value, 4);
+    storeLE(p, v, 4);
+  }
+}
+
+static bool mapFile(const char *path, WavMap &map, int flags, off_t size)
+{
+  const int fd = open(path, flags, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  bool ok = size ? !ftruncate(fd, size) : !fstat(fd, &st);
+  if (ok) {
+    map.size = size ? size : st.st_size;
+    void *p = mmap(0, map.size, size ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    ok = p != MAP_FAILED;
+    map.base = ok ? (uint8_t *)p : 0;
+  }
+  close(fd);
+  return ok;
+}
+
+bool wavMapRead(const char *path, WavMap &map)
+{
+  if (!mapFile(path, map, O_RDONLY, 0)) {
+    return false;
+  }
+  WavFormat fmt;
+  if (!parse(map.base, map.size, fmt)) {
+    wavUnmap(map);
+    return false;
+  }
+  map.data = map.base + fmt.data;
+  map.sampleRate = fmt.sampleRate;
+  map.channels = fmt.channels;
+  map.format = fmt.format;
+  map.bits = fmt.bits;
+  map.frames = fmt.dataLen / (fmt.bits / 8) / fmt.channels;
+  return true;
+}
+
+bool wavMapCreate(const char *path, WavMap &map, uint32_t frames, uint16_t channels, uint32_t sampleRate, bool pcm16)
+{
+  const uint32_t dataLen = frames * channels * (pcm16 ? 2 : 4);
+  if (!mapFile(path, map, O_RDWR | O_CREAT | O_TRUNC, 44 + dataLen)) {
+    return false;
+  }
+  header(map.base, dataLen, channels, sampleRate, pcm16);
+  map.data = map.base + 44;
+  map.sampleRate = sampleRate;
+  map.channels = channels;
+  map.format = pcm16 ? 1 : 3;
+  map.bits = pcm16 ? 16 : 32;
+  map.frames = frames;
+  return true;
+}
+
+void wavUnmap(WavMap &map)
+{
+  if (map.base) {
+    munmap(map.base, map.size);
+  }
+  map.base = 0;
+  map.data = 0;
+  map.size = 0;
+}
@@ -0,0 +1,91 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: wav.h
+ *
+ *  Minimal RIFF/WAVE reader and writer for the host tools.
+ */
+
+#ifndef __wav_h
+#define __wav_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+struct WavData {
+  uint32_t sampleRate;
+  uint16_t channels;
+  std::vector<float> samples; // interleaved, normalized to [-1, 1]
+
+  WavData(void) : sampleRate(48000), channels(1) { }
+
+  uint32_t frames(void) const {
+    return channels ? samples.size() / channels : 0;
+  }
+};
+
+// A WAV file mapped into memory, its frames read or written in place.
+struct WavMap {
+  uint8_t *base;
+  size_t size;
+  uint8_t *data; // first frame
+  uint32_t frames;
+  uint32_t sampleRate;
+  uint16_t channels;
+  uint16_t format; // 1 PCM, 3 float
+  uint16_t bits;
+
+  WavMap(void) : base(0), size(0), data(0), frames(0), sampleRate(48000), channels(1), format(1), bits(16) { }
+
+  float sample(uint32_t frame, uint16_t channel) const;
+  void setSample(uint32_t frame, uint16_t channel, float value);
+};
+
+// Reads 16/24/32-bit PCM or 32-bit float files, returns false on failure.
+bool wavRead(const char *path, WavData &wav);
+
+// Writes 32-bit float, or 16-bit PCM when pcm16 is set, returns false on failure.
+bool wavWrite(const char *path, const WavData &wav, bool pcm16);
+
+// Maps a file wavRead() takes, read only. Returns false on failure.
+bool wavMapRead(const char *path, WavMap &map);
+
+// Creates a file of frames silent frames and maps it for writing, 32-bit float
+// or 16-bit PCM when pcm16 is set. Returns false on failure.
+bool wavMapCreate(const char *path, WavMap &map, uint32_t frames, uint16_t channels, uint32_t sampleRate, bool pcm16);
+
+// Unmaps the file, the frames written so far are in it.
+void wavUnmap(WavMap &map);
+
+#endif // __wav_h
@@ -0,0 +1,280 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: adpcm.h
+ *
+ *  4-bit IMA ADPCM sample storage with random access.
+ *
+ *  Samples are stored in blocks of ADPCM_BLOCKSAMPLES nibbles behind a 4 byte
+ *  header holding the decoder state at the start of the block (predictor,
+ *  step index). Readers keep a cursor and decode forward, picking up the
+ *  state from each header they pass, or restart from the header of the block
+ *  they land in when that is shorter.
+ */
+
+#ifndef __adpcm_h
+#define __adpcm_h
+
+#include <stdint.h>
+
+#include "mixq15.h"
+
+#define ADPCM_BLOCKSHIFT 5
+#define ADPCM_BLOCKSAMPLES (1UL << ADPCM_BLOCKSHIFT)
+#define ADPCM_BLOCKMASK (ADPCM_BLOCKSAMPLES - 1)
+#define ADPCM_HEADERBYTES 4
+#define ADPCM_BLOCKBYTES (ADPCM_HEADERBYTES + ADPCM_BLOCKSAMPLES / 2)
+
+// Bytes needed for a number of samples, and samples that fit a number of bytes
+#define ADPCM_BYTES(samples) ((((samples) + ADPCM_BLOCKSAMPLES - 1) >> ADPCM_BLOCKSHIFT) * ADPCM_BLOCKBYTES)
+#define ADPCM_SAMPLES(bytes) (((bytes) / ADPCM_BLOCKBYTES) << ADPCM_BLOCKSHIFT)
+
+#define ADPCM_NOSAMPLE 0xffffffff
+
+static const int16_t adpcmStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t adpcmIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+typedef struct {
+    int32_t predictor;
+    int32_t stepIndex;
+} adpcm_state_t;
+
+// Recorder side, the newest sample is held back until the write index moves on
+typedef struct {
+    adpcm_state_t state;
+    uint32_t idx;
+    int32_t pending;
+} adpcm_encoder_t;
+
+// Reader side, cur is sample idx and prev the one before it
+typedef struct {
+    adpcm_state_t state;
+    uint32_t idx;
+    int16_t prev;
+    int16_t cur;
+} adpcm_cursor_t;
+
+static inline int32_t adpcm_decodeNibble(adpcm_state_t *pState, uint32_t nibble)
+{
+    const int32_t step = adpcmStepTable[pState->stepIndex];
+
+    int32_t diff = step >> 3;
+    if (nibble & 4) {
+        diff += step;
+    }
+    if (nibble & 2) {
+        diff += step >> 1;
+    }
+    if (nibble & 1) {
+        diff += step >> 2;
+    }
+
+    int32_t predictor = (nibble & 8) ? pState->predictor - diff : pState->predictor + diff;
+    if (predictor > 32767) {
+        predictor = 32767;
+    } else if (predictor < -32768) {
+        predictor = -32768;
+    }
+    pState->predictor = predictor;
+
+    int32_t stepIndex = pState->stepIndex + adpcmIndexTable[nibble];
+    if (stepIndex < 0) {
+        stepIndex = 0;
+    } else if (stepIndex > 88) {
+        stepIndex = 88;
+    }
+    pState->stepIndex = stepIndex;
+
+    return predictor;
+}
+
+static inline uint32_t adpcm_encodeSample(adpcm_state_t *pState, int32_t sample)
+{
+    const int32_t step = adpcmStepTable[pState->stepIndex];
+
+    int32_t diff = sample - pState->predictor;
+    uint32_t nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    if (diff >= step) {
+        nibble |= 4;
+        diff -= step;
+    }
+    if (diff >= (step >> 1)) {
+        nibble |= 2;
+        diff -= step >> 1;
+    }
+    if (diff >= (step >> 2)) {
+        nibble |= 1;
+    }
+
+    // Track the decoder so that the next difference is taken from what it will see
+    adpcm_decodeNibble(pState, nibble);
+    return nibble;
+}
+
+static inline uint8_t *adpcm_block(uint8_t *pBuf, uint32_t idx)
+{
+    return &pBuf[(idx >> ADPCM_BLOCKSHIFT) * ADPCM_BLOCKBYTES];
+}
+
+static inline uint32_t adpcm_readNibble(const uint8_t *pBuf, uint32_t idx)
+{
+    const uint8_t byte = pBuf[(idx >> ADPCM_BLOCKSHIFT) * ADPCM_BLOCKBYTES + ADPCM_HEADERBYTES + ((idx & ADPCM_BLOCKMASK) >> 1)];
+    return (idx & 1) ? (byte >> 4) : (byte & 0x0f);
+}
+
+static inline void adpcm_write(uint8_t *pBuf, adpcm_state_t *pState, uint32_t idx, int32_t sample)
+{
+    uint8_t *pBlock = adpcm_block(pBuf, idx);
+    const uint32_t k = idx & ADPCM_BLOCKMASK;
+
+    if (!k) {
+        pBlock[0] = (uint8_t)pState->predictor;
+        pBlock[1] = (uint8_t)(pState->predictor >> 8);
+        pBlock[2] = (uint8_t)pState->stepIndex;
+        pBlock[3] = 0;
+    }
+
+    const uint32_t nibble = adpcm_encodeSample(pState, sample);
+    uint8_t *pByte = &pBlock[ADPCM_HEADERBYTES + (k >> 1)];
+    if (k & 1) {
+        *pByte = (*pByte & 0x0f) | (uint8_t)(nibble << 4);
+    } else {
+        *pByte = (uint8_t)nibble;
+    }
+}
+
+static inline void adpcm_encoderReset(adpcm_encoder_t *pEncoder)
+{
+    pEncoder->state.predictor = 0;
+    pEncoder->state.stepIndex = 0;
+    pEncoder->idx = 0;
+    pEncoder->pending = 0;
+}
+
+// Stores sample at idx. A repeated idx replaces the pending sample, the recorder
+// step never exceeds one sample so idx otherwise moves on by one.
+static inline void adpcm_put(adpcm_encoder_t *pEncoder, uint8_t *pBuf, uint32_t idx, int32_t sample)
+{
+    if (idx != pEncoder->idx) {
+        adpcm_write(pBuf, &pEncoder->state, pEncoder->idx, pEncoder->pending);
+        pEncoder->idx = idx;
+    }
+    pEncoder->pending = sample;
+}
+
+static inline void adpcm_flush(adpcm_encoder_t *pEncoder, uint8_t *pBuf)
+{
+    adpcm_write(pBuf, &pEncoder->state, pEncoder->idx, pEncoder->pending);
+}
+
+static inline void adpcm_cursorReset(adpcm_cursor_t *pCursor)
+{
+    pCursor->idx = ADPCM_NOSAMPLE;
+}
+
+// Samples idx and idx + 1 packed into a word (bottom, top)
+static inline uint32_t adpcm_pair(adpcm_cursor_t *pCursor, const uint8_t *pBuf, uint32_t idx)
+{
+    const uint32_t target = idx + 1;
+    uint32_t pos = pCursor->idx;
+
+    if (pos != target) {
+        const uint32_t blockStart = idx & ~ADPCM_BLOCKMASK;
+
+        // Going back, or no closer than decoding the block of idx from its header
+        if (target - pos >= (idx - blockStart) + 2) {
+            pos = blockStart - 1;
+        }
+
+        int32_t prev = pCursor->prev;
+        int32_t cur = pCursor->cur;
+        while (pos != target) {
+            pos++;
+            if (!(pos & ADPCM_BLOCKMASK)) {
+                // Resync at every header, a block may have been recorded over since
+                const uint8_t *pBlock = &pBuf[(pos >> ADPCM_BLOCKSHIFT) * ADPCM_BLOCKBYTES];
+                pCursor->state.predictor = (int16_t)(pBlock[0] | (pBlock[1] << 8));
+                pCursor->state.stepIndex = pBlock[2];
+            }
+            prev = cur;
+            cur = adpcm_decodeNibble(&pCursor->state, adpcm_readNibble(pBuf, pos));
+        }
+        pCursor->prev = (int16_t)prev;
+        pCursor->cur = (int16_t)cur;
+        pCursor->idx = pos;
+    }
+
+    return mix_pkhbt((uint16_t)pCursor->prev, (uint16_t)pCursor->cur);
+}
+
+// mixQ15() for ADPCM storage, the cursor follows the phase
+static inline uint32_t mixAdpcm(int32_t *pMix, const uint8_t *pBuf, adpcm_cursor_t *pCursor,
+                                uint32_t phase, uint32_t step, int32_t gain, int32_t gainInc, uint32_t frames)
+{
+    adpcm_cursor_t cursor = *pCursor;
+
+    for (; frames; frames--) {
+        const uint32_t idx = phase >> PHASE_FRACBITS;
+        const uint32_t fr = (phase & PHASE_FRACMASK) >> (PHASE_FRACBITS - MIX_COEFBITS);
+
+        const int32_t sample = mix_smuad(adpcm_pair(&cursor, pBuf, idx), mix_pkhbt((1UL << MIX_COEFBITS) - fr, fr));
+        *pMix = mix_smlawt(sample, gain, *pMix);
+
+        pMix += 2;
+        phase += step;
+        gain += gainInc;
+    }
+
+    *pCursor = cursor;
+    return phase;
+}
+
+#endif // __adpcm_h
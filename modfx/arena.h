@@ -0,0 +1,163 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: arena.h
+ *
+ *  Sample slots in one memory region.
+ *
+ *  Slots are placed one after the other, going round: a new slot goes
+ *  right after the last one, or back at the start of the region when it
+ *  does not fit there, and the slots it lands on are dropped. As slots are
+ *  placed in order, those are the oldest. One slot, the one playing, can be
+ *  kept: a new slot that would land on it goes after it, or before it, and
+ *  is shortened to the room there is if need be. The last slot can be shortened
+ *  once its recording is done, so the next one follows the sound rather
+ *  than the room it was given. Nothing is ever moved, there is no
+ *  fragmentation to compact, and the table only changes when a capture
+ *  starts or ends.
+ */
+
+#ifndef __arena_h
+#define __arena_h
+
+#include <stdint.h>
+
+#ifndef ARENA_SLOTS
+#define ARENA_SLOTS 8 // at most 32, dropped slots are returned as a mask
+#endif
+#define ARENA_NONE 0xff
+
+typedef struct {
+    uint32_t offset; // units from the start of the region
+    uint32_t length;
+    uint32_t serial; // placing order
+    uint8_t isUsed;
+} arena_slot_t;
+
+typedef struct {
+    arena_slot_t slots[ARENA_SLOTS];
+    uint32_t size;
+    uint32_t head; // where the next slot goes
+    uint32_t serial;
+    uint8_t last;
+} arena_t;
+
+static inline void arena_reset(arena_t *p, uint32_t size)
+{
+    for (uint8_t k = 0; k < ARENA_SLOTS; k++) {
+        p->slots[k].isUsed = 0;
+    }
+    p->size = size;
+    p->head = 0;
+    p->serial = 0;
+    p->last = ARENA_NONE;
+}
+
+// Places a slot of length units, returns it (or ARENA_NONE when it is larger than
+// the region) and the mask of the slots that were dropped to make room. Slot keep
+// (or ARENA_NONE) is not dropped as long as there are minLength units beside it,
+// the slot may come out shorter than length then.
+static inline uint8_t arena_alloc(arena_t *p, uint32_t length, uint32_t minLength, uint8_t keep, uint32_t *pDropped)
+{
+    *pDropped = 0;
+    if (length > p->size) {
+        return ARENA_NONE;
+    }
+
+    uint32_t offset = p->head + length <= p->size ? p->head : 0;
+    if (keep != ARENA_NONE && p->slots[keep].isUsed) {
+        const uint32_t keepStart = p->slots[keep].offset;
+        const uint32_t keepEnd = keepStart + p->slots[keep].length;
+        const uint32_t after = p->size - keepEnd;
+        if (offset < keepEnd && keepStart < offset + length) {
+            if (after >= length) {
+                offset = keepEnd;
+            } else if (keepStart >= length) {
+                offset = 0;
+            } else if (after >= keepStart && after >= minLength) {
+                offset = keepEnd;
+                length = after;
+            } else if (keepStart > after && keepStart >= minLength) {
+                offset = 0;
+                length = keepStart;
+            }
+        }
+    }
+    uint8_t k;
+    for (k = 0; k < ARENA_SLOTS; k++) {
+        arena_slot_t *pSlot = &p->slots[k];
+        if (pSlot->isUsed && pSlot->offset < offset + length && offset < pSlot->offset + pSlot->length) {
+            pSlot->isUsed = 0;
+            *pDropped |= 1UL << k;
+        }
+    }
+
+    // A free entry, or the oldest one when the table is full
+    uint8_t free = ARENA_NONE;
+    for (k = 0; k < ARENA_SLOTS; k++) {
+        if (!p->slots[k].isUsed) {
+            free = k;
+            break;
+        }
+        if (free == ARENA_NONE || p->slots[k].serial < p->slots[free].serial) {
+            free = k;
+        }
+    }
+    if (p->slots[free].isUsed) {
+        *pDropped |= 1UL << free;
+    }
+
+    arena_slot_t *pSlot = &p->slots[free];
+    pSlot->offset = offset;
+    pSlot->length = length;
+    pSlot->serial = p->serial++;
+    pSlot->isUsed = 1;
+    p->head = offset + length;
+    p->last = free;
+    return free;
+}
+
+// Shortens a slot to length units, room after the last slot goes to the next one
+static inline void arena_shrink(arena_t *p, uint8_t k, uint32_t length)
+{
+    arena_slot_t *pSlot = &p->slots[k];
+    if (length >= pSlot->length) {
+        return;
+    }
+    pSlot->length = length;
+    if (k == p->last) {
+        p->head = pSlot->offset + length;
+    }
+}
+
+#endif // __arena_h
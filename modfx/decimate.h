@@ -0,0 +1,196 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: decimate.h
+ *
+ *  Decimating recorder filter, one output sample per stored sample.
+ *
+ *  The input runs through up to DECIM_STAGES half-band stages, each halving
+ *  the rate, until the stored rate is within an octave of it. A polyphase
+ *  windowed sinc then computes the stored samples at their fractional
+ *  positions, so the long filter only runs at the stored rate. The branch
+ *  table is designed when the rate changes, at the start of a capture.
+ */
+
+#ifndef __decimate_h
+#define __decimate_h
+
+#include <stdint.h>
+
+#define DECIM_STAGES 3 // down to an eighth of the input rate
+#define DECIM_HISTORY 16 // power of two, at least DECIM_TAPS and the half-band length
+#define DECIM_HISTMASK (DECIM_HISTORY - 1)
+
+// 11 tap half-band (Kaiser, beta 4), every other coefficient is zero
+#define DECIM_HB1 0.30269f
+#define DECIM_HB3 -0.06707f
+#define DECIM_HB5 0.01490f
+
+#define DECIM_TAPS 12
+#define DECIM_PHASEBITS 3 // branches, linearly interpolated
+#define DECIM_PHASES (1UL << DECIM_PHASEBITS)
+#define DECIM_CUTOFF 0.45f // of the stored rate
+
+#define DECIM_POSBITS 16
+#define DECIM_POSONE (1UL << DECIM_POSBITS)
+#define DECIM_FRACBITS (DECIM_POSBITS - DECIM_PHASEBITS)
+
+typedef struct {
+    float hist[DECIM_HISTORY];
+    uint32_t idx;
+} decim_history_t;
+
+typedef struct {
+    decim_history_t halfband[DECIM_STAGES];
+    decim_history_t branch;
+    uint32_t pos; // next output position after the oldest tap in the branch, DECIM_POSBITS fraction
+    uint32_t posStep; // input samples per output sample after the half-bands
+    uint8_t stages;
+    float step; // the table is designed for this
+    int16_t coefs[DECIM_PHASES + 1][DECIM_TAPS]; // Q15, each branch sums to one
+} decimator_t;
+
+// sin(pi * x), parabolic with one refinement, for designing the tables
+static inline float decim_sinpi(float x)
+{
+    x -= 2.f * (float)(int32_t)(x * 0.5f + (x < 0 ? -0.5f : 0.5f)); // to [-1, 1]
+    const float y = 4.f * x * (1.f - (x < 0 ? -x : x));
+    return 0.225f * (y * (y < 0 ? -y : y) - y) + y;
+}
+
+static inline void decim_push(decim_history_t *p, float x)
+{
+    p->idx = (p->idx + 1) & DECIM_HISTMASK;
+    p->hist[p->idx] = x;
+}
+
+// Half-band decimation by two, true with *pX replaced on every other sample
+static inline uint8_t decim_halfband(decim_history_t *p, float *pX)
+{
+    decim_push(p, *pX);
+    const uint32_t i = p->idx;
+    if (i & 1) {
+        return 0;
+    }
+
+    const float *h = p->hist;
+    *pX = 0.5f * h[(i - 5) & DECIM_HISTMASK]
+        + DECIM_HB1 * (h[(i - 4) & DECIM_HISTMASK] + h[(i - 6) & DECIM_HISTMASK])
+        + DECIM_HB3 * (h[(i - 2) & DECIM_HISTMASK] + h[(i - 8) & DECIM_HISTMASK])
+        + DECIM_HB5 * (h[i] + h[(i - 10) & DECIM_HISTMASK]);
+    return 1;
+}
+
+// Sets up for a capture at step stored samples per input sample (0 < step <= 1),
+// the branch table is only redesigned when the step changed.
+static inline void decim_reset(decimator_t *p, float step)
+{
+    uint8_t stages = 0;
+    float branchStep = step;
+    while (branchStep <= 0.5f && stages < DECIM_STAGES) {
+        branchStep *= 2.f;
+        stages++;
+    }
+    p->stages = stages;
+    p->posStep = (uint32_t)((float)DECIM_POSONE / branchStep);
+    p->pos = DECIM_POSONE;
+
+    for (uint8_t s = 0; s < DECIM_STAGES; s++) {
+        p->halfband[s].idx = 0;
+        for (uint8_t j = 0; j < DECIM_HISTORY; j++) {
+            p->halfband[s].hist[j] = 0;
+        }
+    }
+    p->branch.idx = 0;
+    for (uint8_t j = 0; j < DECIM_HISTORY; j++) {
+        p->branch.hist[j] = 0;
+    }
+
+    if (step == p->step) {
+        return;
+    }
+    p->step = step;
+
+    // Hann windowed sinc, tap m of branch k sits (m - DECIM_TAPS / 2 + k / DECIM_PHASES)
+    // samples from the output
+    const float fc = 2.f * DECIM_CUTOFF * branchStep;
+    for (uint32_t k = 0; k <= DECIM_PHASES; k++) {
+        float taps[DECIM_TAPS];
+        float sum = 0;
+        for (uint32_t m = 0; m < DECIM_TAPS; m++) {
+            const float u = (float)m - (float)(DECIM_TAPS / 2) + (float)k * (1.f / DECIM_PHASES);
+            const float w = 0.5f + 0.5f * decim_sinpi(u * (2.f / DECIM_TAPS) + 0.5f);
+            const float x = fc * u;
+            taps[m] = w * ((x < 1e-6f && x > -1e-6f) ? 1.f : decim_sinpi(x) / (3.14159265f * x));
+            sum += taps[m];
+        }
+        for (uint32_t m = 0; m < DECIM_TAPS; m++) {
+            p->coefs[k][m] = (int16_t)(taps[m] * (32767.f / sum) + (taps[m] < 0 ? -0.5f : 0.5f));
+        }
+    }
+}
+
+// Feeds one input sample, true with *pOut set when the next stored sample is due
+static inline uint8_t decim_process(decimator_t *p, float x, float *pOut)
+{
+    for (uint8_t s = 0; s < p->stages; s++) {
+        if (!decim_halfband(&p->halfband[s], &x)) {
+            return 0;
+        }
+    }
+
+    decim_push(&p->branch, x);
+    const uint32_t pos = p->pos - DECIM_POSONE;
+    if (pos >= DECIM_POSONE) {
+        p->pos = pos;
+        return 0;
+    }
+    p->pos = pos + p->posStep;
+
+    // The two branches around the output position, tap 0 is the newest sample
+    const int16_t *c0 = p->coefs[pos >> DECIM_FRACBITS];
+    const int16_t *c1 = c0 + DECIM_TAPS;
+    const float *h = p->branch.hist;
+    const uint32_t i = p->branch.idx;
+    float y0 = 0, y1 = 0;
+    for (uint32_t m = 0; m < DECIM_TAPS; m++) {
+        const float in = h[(i - m) & DECIM_HISTMASK];
+        y0 += (float)c0[m] * in;
+        y1 += (float)c1[m] * in;
+    }
+    const float frac = (float)(pos & ((1UL << DECIM_FRACBITS) - 1)) * (1.f / (1UL << DECIM_FRACBITS));
+    *pOut = (y0 + (y1 - y0) * frac) * (1.f / 32767.f);
+    return 1;
+}
+
+#endif // __decimate_h
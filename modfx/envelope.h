@@ -0,0 +1,135 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: envelope.h
+ *
+ *  Control rate voice envelopes.
+ *
+ *  An envelope is a run of linear segments counted in output frames: an
+ *  attack from silence to the voice level, a release to silence, or a
+ *  crossfade out from the current gain. The renderer mixes up to the end of the current segment
+ *  with the gain and per frame increment, then advances the envelope once
+ *  for the frames it rendered. Increments are worked out when a segment
+ *  starts, the mix loops only add them.
+ */
+
+#ifndef __envelope_h
+#define __envelope_h
+
+#include <stdint.h>
+
+#include "mixq15.h"
+
+#define ENV_ATTACK 0
+#define ENV_RELEASE 1
+#define ENV_DONE 2
+
+typedef struct {
+    int32_t gain; // MIX_GAINBITS
+    int32_t inc; // per frame
+    uint32_t frames; // left in the segment
+    uint32_t releaseFrames; // after the attack
+    int32_t level; // reached by the attack
+    uint8_t stage;
+} env_t;
+
+// Linear ramp from the current gain to target over frames (frames > 0)
+static inline void env_ramp(env_t *p, int32_t target, uint32_t frames)
+{
+    p->frames = frames;
+    p->inc = (target - p->gain) / (int32_t)frames;
+}
+
+// Ramps to zero from the current gain over frames, or ends right away
+static inline void env_release(env_t *p, uint32_t frames)
+{
+    if (!frames) {
+        p->gain = 0;
+        p->stage = ENV_DONE;
+        return;
+    }
+    p->stage = ENV_RELEASE;
+    env_ramp(p, 0, frames);
+}
+
+// Rises from silence to level (at most MIX_GAINONE) over attackFrames and falls
+// back over releaseFrames, both shortened to fit within totalFrames
+static inline void env_start(env_t *p, uint32_t attackFrames, uint32_t releaseFrames, uint32_t totalFrames,
+                             int32_t level)
+{
+    if (attackFrames > totalFrames) {
+        attackFrames = totalFrames;
+    }
+    if (releaseFrames > totalFrames - attackFrames) {
+        releaseFrames = totalFrames - attackFrames;
+    }
+
+    p->gain = 0;
+    p->releaseFrames = releaseFrames;
+    if (!attackFrames) {
+        env_release(p, releaseFrames);
+        return;
+    }
+    p->stage = ENV_ATTACK;
+    p->level = level;
+    env_ramp(p, level, attackFrames);
+}
+
+// Frames until the envelope is done
+static inline uint32_t env_framesLeft(const env_t *p)
+{
+    if (p->stage == ENV_DONE) {
+        return 0;
+    }
+    return p->frames + (p->stage == ENV_ATTACK ? p->releaseFrames : 0);
+}
+
+// Moves on by frames (at most p->frames), landing exactly on the segment target
+static inline void env_advance(env_t *p, uint32_t frames)
+{
+    p->gain += p->inc * (int32_t)frames;
+    p->frames -= frames;
+    if (p->frames) {
+        return;
+    }
+
+    if (p->stage == ENV_ATTACK) {
+        p->gain = p->level;
+        env_release(p, p->releaseFrames);
+    } else {
+        p->gain = 0;
+        p->stage = ENV_DONE;
+    }
+}
+
+#endif // __envelope_h
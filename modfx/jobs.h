@@ -0,0 +1,165 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: jobs.h
+ *
+ *  Background work, a slice at the end of each block.
+ *
+ *  A job is a resumable state machine: a function that carries on from
+ *  where it left off, spends the work units it is given and tells whether
+ *  it has more to do. Jobs run in the order they were added, within a
+ *  budget of JOB_BUDGET units per JOB_PERIOD frames. A unit is about ten
+ *  cycles of the Cortex-M4, each job charges its loops by what they cost
+ *  there, so the budget bounds the time taken from the block deadline (and
+ *  keeps renders the same on any host or block size).
+ *
+ *  The costs are llvm-mca's for the Cortex-M4 on the inner loops built for
+ *  it, with the sample reads at SRAM speed: about 10 cycles per sample pair
+ *  compared for a loop candidate, 20 per sample scanned or crossfaded, 6 to
+ *  12 per sample in the pitch search and 290 per mipmap sample. SDRAM wait
+ *  states come on top. A TOMMY_PROFILE build records the DWT cycles and the
+ *  units of each slice (see profile.h) to check them on the device.
+ *
+ *  Each job is tagged with what its results belong to, the buffer it works
+ *  on. Whatever waits for the results polls jobs_pending() for the tag, and
+ *  jobs_cancel() drops the jobs when it is written over. No job is ever run
+ *  past its budget: a full queue refuses a new one instead.
+ */
+
+#ifndef __jobs_h
+#define __jobs_h
+
+#include <stdint.h>
+
+#define JOB_SLOTS 4
+#define JOB_PERIOD 64 // frames
+#define JOB_BUDGET 1024 // units per period, some 10k cycles, 4% of the 240k at 180 MHz
+
+// Spends *pBudget (the last step may overdraw it), returns 1 while not done
+typedef uint8_t (*job_fn_t)(void *pContext, int32_t *pBudget);
+
+typedef struct {
+    job_fn_t fn;
+    void *pContext;
+    const void *pTag;
+} job_t;
+
+typedef struct {
+    job_t jobs[JOB_SLOTS];
+    uint8_t count;
+    uint32_t frames; // since the last slice
+} jobs_t;
+
+static inline void jobs_reset(jobs_t *p)
+{
+    p->count = 0;
+    p->frames = 0;
+}
+
+static inline void jobs_remove(jobs_t *p, uint8_t k)
+{
+    p->count--;
+    for (; k < p->count; k++) {
+        p->jobs[k] = p->jobs[k + 1];
+    }
+}
+
+// Queues a job, or starts over one with the same context. Returns 0 when the
+// queue is full, the job is not run and its results never come.
+static inline uint8_t jobs_add(jobs_t *p, job_fn_t fn, void *pContext, const void *pTag)
+{
+    for (uint8_t k = 0; k < p->count; k++) {
+        if (p->jobs[k].pContext == pContext) {
+            jobs_remove(p, k);
+            break;
+        }
+    }
+    if (p->count == JOB_SLOTS) {
+        return 0;
+    }
+    job_t *pJob = &p->jobs[p->count++];
+    pJob->fn = fn;
+    pJob->pContext = pContext;
+    pJob->pTag = pTag;
+    return 1;
+}
+
+// Drops the jobs of a tag
+static inline void jobs_cancel(jobs_t *p, const void *pTag)
+{
+    uint8_t k = 0;
+    while (k < p->count) {
+        if (p->jobs[k].pTag == pTag) {
+            jobs_remove(p, k);
+        } else {
+            k++;
+        }
+    }
+}
+
+// True while jobs of a tag are queued
+static inline uint8_t jobs_pending(const jobs_t *p, const void *pTag)
+{
+    for (uint8_t k = 0; k < p->count; k++) {
+        if (p->jobs[k].pTag == pTag) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Runs the queued jobs for a budget, returns the units spent
+static inline int32_t jobs_run(jobs_t *p, int32_t budget)
+{
+    const int32_t given = budget;
+    while (p->count && budget > 0) {
+        if (!p->jobs[0].fn(p->jobs[0].pContext, &budget)) {
+            jobs_remove(p, 0);
+        }
+    }
+    return given - budget;
+}
+
+// Counts rendered frames, with a slice of JOB_BUDGET every JOB_PERIOD.
+// Returns the units spent.
+static inline int32_t jobs_tick(jobs_t *p, uint32_t frames)
+{
+    p->frames += frames;
+    if (p->frames < JOB_PERIOD) {
+        return 0;
+    }
+    p->frames -= JOB_PERIOD;
+    return jobs_run(p, JOB_BUDGET);
+}
+
+#endif // __jobs_h
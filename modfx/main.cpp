@@ -35,22 +35,158 @@
 #include "float_math.h"
 #include "biquad.hpp"
 
-#define STEREO_PING_PONG // Enable for stereo ping-pong playback/output
+#ifdef SAMPLE_ADPCM // 4-bit ADPCM sample storage, enable with -DSAMPLE_ADPCM in UDEFS
+    #define PHASE_FRACBITS 15 // 17 bit sample index for the longer buffers
+#endif
+#ifdef SAMPLE_MIPMAP // half rate copies for the notes above the root, enable with -DSAMPLE_MIPMAP in UDEFS
+    #ifndef MIP_LEVELS
+    #define MIP_LEVELS 1 // 1 or 2, a slot takes 1.5 or 1.75 times the sample
+    #endif
+    #define SUSTAIN_ALIGN (1 << MIP_LEVELS) // the loop halves into whole samples at each level
+#endif
+#ifndef SAMPLE_KIT
+    #define ARENA_SLOTS 4 // the sample playing, the one recorded and the ones voices still fade out of
+#endif
+#if defined(SUSTAIN_LOOP) || defined(PITCH_DETECT) || defined(SAMPLE_MIPMAP)
+    #define SAMPLE_JOBS // post-capture work, see jobs.h
+#endif
+
+#include "mixq15.h"
+#include "adpcm.h"
+#include "decimate.h"
+#include "envelope.h"
+#include "onset.h"
+#include "sustain.h"
+#include "jobs.h"
+#include "arena.h"
+#include "mipmap.h"
+#include "pitch.h"
+#ifdef TOMMY_PROFILE // per-block statistics, enable with -DTOMMY_PROFILE in UDEFS
+#include "profile.h"
+#endif
 
+#ifndef NVOICES // Polyphony, may be raised with -DNVOICES=n in UDEFS
 #ifdef STEREO_PING_PONG
     #define NVOICES 4
 #else
     #define NVOICES 3
 #endif
+#endif
 
-#define LPFILTER
+#define LPFILTER // anti-alias the recording, first order (or see decimate.h with LPFILTER_DECIMATE)
+#define LPFILTER_CUTOFF 0.45f // of the stored rate, first order
+
+// Build options as constants for the render templates
+#ifdef STEREO_PING_PONG
+static const bool k_pingPong = true;
+#else
+static const bool k_pingPong = false;
+#endif
+#ifdef LPFILTER
+static const bool k_lpFilter = true;
+#else
+static const bool k_lpFilter = false;
+#endif
 
 #define RESAMPLINGRATE 48000.f
 
 #define NOISETHRESHOLD 0.01 
 
 #define BUFMINLENGTH 1024
-#define BUFMAXLENGTH 32767
+#define BUFBYTES 65536 // SDRAM per double buffered recording, two of them fill the 128K
+
+#ifdef SAMPLE_ADPCM
+    #ifndef BUFMAXLENGTH
+    #define BUFMAXLENGTH (ADPCM_SAMPLES(BUFBYTES) - 1)
+    #endif
+    #define BUFGUARD 0
+    #define SLOTUNITS(len) ADPCM_BYTES((len) + 1) // whole blocks, slots stay block aligned
+    #define SLOTMAXLENGTH(units) (ADPCM_SAMPLES(units) - 1) // longest sample in units
+    typedef uint8_t store_t;
+#else
+    // Room for the interpolation taps around the recorded samples
+    #define BUFGUARD (MIX_TAPSBEFORE + MIX_TAPSAFTER - 1)
+    #define BASEUNITS(len) (((len) + 1 + BUFGUARD + 1) & ~1UL) // even, slots stay word aligned
+#ifdef SAMPLE_MIPMAP
+    // Longest sample whose slot with its copies fits in units
+    #define MIPMAXLENGTH(units) \
+        ((((units) - (MIP_LEVELS + 1) * (BUFGUARD + 2)) << MIP_LEVELS) / ((2 << MIP_LEVELS) - 1))
+    #ifndef BUFMAXLENGTH
+    #define BUFMAXLENGTH MIPMAXLENGTH(BUFBYTES / 2)
+    #endif
+    #if MIP_LEVELS > 1
+    #define SLOTUNITS(len) \
+        (BASEUNITS(len) + BASEUNITS(MIPMAP_LENGTH(len)) + BASEUNITS(MIPMAP_LENGTH(MIPMAP_LENGTH(len))))
+    #else
+    #define SLOTUNITS(len) (BASEUNITS(len) + BASEUNITS(MIPMAP_LENGTH(len)))
+    #endif
+    #define SLOTMAXLENGTH(units) MIPMAXLENGTH(units)
+#else
+    #ifndef BUFMAXLENGTH
+    #define BUFMAXLENGTH ((BUFBYTES / 2) - 1 - BUFGUARD)
+    #endif
+    #define SLOTUNITS(len) BASEUNITS(len)
+    #define SLOTMAXLENGTH(units) (((units) & ~1UL) - 1 - BUFGUARD)
+#endif
+    typedef int16_t store_t;
+#endif
+#if defined(SAMPLE_MIPMAP) && defined(SAMPLE_ADPCM)
+#error "SAMPLE_MIPMAP does not support SAMPLE_ADPCM"
+#endif
+#if defined(SUSTAIN_LOOP) && defined(SAMPLE_ADPCM)
+#error "SUSTAIN_LOOP does not support SAMPLE_ADPCM"
+#endif
+#if defined(PITCH_DETECT) && defined(SAMPLE_ADPCM)
+#error "PITCH_DETECT does not support SAMPLE_ADPCM"
+#endif
+#if defined(VOICE_WINDOW) && defined(SAMPLE_ADPCM)
+#error "VOICE_WINDOW does not support SAMPLE_ADPCM"
+#endif
+
+#ifdef SAMPLE_STREAM // one circular buffer for re-trigger mode, enable with -DSAMPLE_STREAM in UDEFS
+#ifdef SAMPLE_ADPCM
+#error "SAMPLE_STREAM does not support SAMPLE_ADPCM"
+#endif
+    // The ring takes the whole arena, the guards either side repeat its other end
+    #define ARENALENGTH SLOTUNITS(BUFMAXLENGTH)
+    #define RINGLENGTH BUFMAXLENGTH
+    #define RINGPHASE ((uint32_t)RINGLENGTH << PHASE_FRACBITS)
+#else
+    #define ARENALENGTH (2 * SLOTUNITS(BUFMAXLENGTH))
+#endif
+#define ARENAMAXLENGTH SLOTMAXLENGTH(ARENALENGTH)
+
+// Sample slots, see arena.h. By default a single trigger capture takes half the
+// arena, so the last sample plays on while the next one is recorded. SAMPLE_LONG
+// trades that for one sample in the whole arena, SAMPLE_KIT keeps the captures as a
+// kit where each note plays the one with the nearest root.
+#define PHASEMAXLENGTH ((1UL << (32 - PHASE_FRACBITS)) - STEPMAX - 3)
+#ifdef SAMPLE_LONG // about 1.36 s at 48k, enable with -DSAMPLE_LONG in UDEFS
+    #define SINGLELENGTH (ARENAMAXLENGTH < PHASEMAXLENGTH ? ARENAMAXLENGTH : PHASEMAXLENGTH)
+#else
+    #define SINGLELENGTH BUFMAXLENGTH
+#endif
+
+// Voices pick the interpolation from their step, the costlier ones where the images
+// would be heard. Set a limit to 0 to leave a tier out. The sinc tier does not fit
+// the SRAM next to the default build, enable it with -DINTERP_SINC in UDEFS.
+#ifdef INTERP_SINC
+#ifndef INTERP_SINC_MAXSTEP
+#define INTERP_SINC_MAXSTEP 1.f // pitched down or at the root
+#endif
+#endif
+#ifndef INTERP_HERMITE_MAXSTEP
+#define INTERP_HERMITE_MAXSTEP 2.f // up to an octave above the root
+#endif
+
+// VOICE_WINDOW copies the samples a voice reads in a pass from the SDRAM to SRAM
+// in one burst of word reads, so the kernels only read SRAM. Voices stepping over
+// WINDOW_MAXSTEP skip most of the samples and read the SDRAM directly.
+#ifndef WINDOW_MAXSTEP
+#define WINDOW_MAXSTEP 2 // up to an octave above the root
+#endif
+
+#define STEPMAX 255 // playback step limit, just under 8 octaves above the root
 
 #define SAMPLEMODE_NOTRIG 0
 #define SAMPLEMODE_SINGLETRIG 1
@@ -60,257 +196,1181 @@
 
 #define SDIV 32767
 
-int16_t bufA[BUFMAXLENGTH + 1] __sdram;
-int16_t bufB[BUFMAXLENGTH + 1] __sdram;
-
-int16_t *pBufSampling;
-float samplingIdx;
-float samplingStep, currentSamplingStep, nextSamplingStep;
-uint16_t samplingBufLen;
-uint16_t lastSampledBufLength;
-float samplingRootFreq;
-float samplingTrigFreq;
-
-int16_t *pBufPlayback;
-uint16_t playbackBufLength;
-float playbackRootFreq;
-float playbackStep[NVOICES];
-float playbackIdx[NVOICES];
-uint16_t playbackBufLen[NVOICES];
-int16_t *pPlaybackBuf[NVOICES];
-
-float xfadePlaybackStep[NVOICES];
-float xfadePlaybackIdx[NVOICES];
-float xfadeLastGain[NVOICES];
-uint16_t xfadePlaybackBufLen[NVOICES];
-int16_t *pXfadePlaybackBuf[NVOICES];
-
-uint32_t dutySampleCount;
+// Levels, see onset.h. Without SAMPLE_TRIM recordings are played and captured at
+// unity. With it each recording is played at the gain that brings it to LEVEL_RMS
+// without its peak going over full scale, at most LEVEL_GAINMAX. The voice envelopes
+// carry the gain over LEVEL_GAINMAX, the output scale puts it back. Re-trigger
+// captures are recorded at the gain that would have brought the peak of the last
+// one to LEVEL_CAPTUREPEAK, at most LEVEL_CAPTUREGAINMAX.
+#define LEVEL_RMS 0.25f // -12 dBFS
+#define LEVEL_GAINMAX 8.f
+#define LEVEL_UNITY ((int32_t)(MIX_GAINONE / LEVEL_GAINMAX))
+#define LEVEL_CAPTUREPEAK 0.5f
+#define LEVEL_CAPTUREGAINMAX 4.f
+
+#define k_mix_scalef (LEVEL_GAINMAX / ((float)(1L << MIX_SHIFT) * (float)SDIV))
+
+#define XFADELENGTH 128 // attack, crossfade out of a stolen voice and recording fade-in
+#define NOTEOFFLENGTH 480 // release of a note that is let go, 10 ms
+#define XFADEPHASE ((uint32_t)XFADELENGTH << PHASE_FRACBITS)
+
+// Release time range of the A encoder in output frames, 21 ms to 4 s
+#define RELEASEMIN 1024
+#define RELEASEMAX 192000
+
+#if BUFMAXLENGTH > PHASEMAXLENGTH
+#error "BUFMAXLENGTH does not fit the phase accumulators"
+#endif
+
+// Notes arrive from the oscillator as a marker (+1 for a note-on, -1 for a note-off),
+// PITCHFRAME_BITS pitch bits (note << 8 | fine, msb first, sign coded) and a silent
+// guard sample. Must match oscillator/main.cpp.
+#define PITCHFRAME_BITS 16
+#define PITCHFRAME_LENGTH (PITCHFRAME_BITS + 2)
+#define PITCH_NONE 0xffff
+
+#define MAXFRAMES 64 // frames rendered per pass
+#define MAXTRIGGERS ((MAXFRAMES + PITCHFRAME_LENGTH - 1) / PITCHFRAME_LENGTH) // frames end at least PITCHFRAME_LENGTH apart
+
+typedef struct {
+    uint32_t frame;
+    uint16_t pitch;
+    uint8_t isOff;
+} trigger_t;
+
+// A recording in an arena slot
+typedef struct {
+    store_t *pBuf; // sample 0
+    float step; // stored rate over the output rate
+    uint32_t start; // onset
+    uint32_t end; // last sample played
+    uint32_t loopStart; // when loopEnd is not 0
+    uint32_t loopEnd;
+    int32_t level; // envelope level
+#ifdef SAMPLE_MIPMAP
+    store_t *pMip[MIP_LEVELS]; // half rate copies, each of the one before
+    uint8_t mipLevels; // copies done
+#endif
+    uint16_t rootPitch;
+    uint8_t isReady;
+} sample_t;
+
+// A sound a voice plays. With a loop length the phase moves back by it on reaching
+// the loop end.
+typedef struct {
+    uint32_t step;
+    uint32_t phase;
+    uint32_t loopEnd;
+    uint32_t loopLength;
+    store_t *pBuf;
+    env_t env;
+#ifdef SAMPLE_ADPCM
+    adpcm_cursor_t cursor;
+#endif
+} voice_play_t;
+
+// A voice, with the sound it crossfades out of when it was stolen
+typedef struct {
+    voice_play_t play;
+    voice_play_t xfade;
+
+    uint32_t age;
+    uint16_t pitch; // of the note, for its note-off
+    uint8_t slot;
+    uint8_t channel;
+    uint8_t isActive;
+} voice_t;
+
+store_t sampleMemory[ARENALENGTH] __sdram;
+arena_t arena;
+sample_t samples[ARENA_SLOTS];
+#ifdef SAMPLE_MIPMAP
+mipmap_t mipBuilds[ARENA_SLOTS]; // the copy of samples[k] in the making
+#endif
+
+uint8_t samplingSlot;
+store_t *pBufSampling;
+uint32_t samplingPhase;
+uint32_t samplingPhaseStep;
+float currentSamplingStep, nextSamplingStep;
+uint32_t samplingBufLen;
+uint16_t samplingTrigPitch;
+uint8_t samplingWait;
+float samplingFade;
+float samplingGain;
+#ifdef LPFILTER_DECIMATE // polyphase decimator, enable with -DLPFILTER_DECIMATE in UDEFS
+decimator_t decimator;
+#else
+dsp::BiQuad lpf;
+#endif
+#ifdef SAMPLE_TRIM // onset, tail and level of each capture, enable with -DSAMPLE_TRIM in UDEFS
+onset_t samplingOnset;
+#endif
+#ifdef SUSTAIN_LOOP // loop the end of each recording, enable with -DSUSTAIN_LOOP in UDEFS
+sustain_t sustainLoop;
+#endif
+#ifdef PITCH_DETECT // key the root of each capture to its pitch, enable with -DPITCH_DETECT in UDEFS
+pitch_t pitchSearch;
+uint8_t pitchSlot; // of the sample searched, one capture completes at a time
+#endif
+#ifdef SAMPLE_JOBS
+jobs_t jobs; // post-capture work on a slot, it is swapped in once the jobs tagged with its pBuf are done
+#endif
+#ifdef SAMPLE_STREAM
+uint8_t samplingLoop, samplingLapped;
+#endif
+#ifdef SAMPLE_ADPCM
+adpcm_encoder_t adpcmEncoder;
+#endif
+
+uint8_t playbackSlot;
+uint32_t playbackBufLength;
+uint32_t releaseFrames;
+
+voice_t voices[NVOICES];
+uint8_t activeVoices[NVOICES];
+uint8_t activeVoiceCount;
+uint32_t voiceAge;
+
+uint32_t pitchRxBits;
+uint8_t pitchRxCount;
+uint8_t pitchRxOff;
 
 uint8_t isSampling, swapBuffers, sampleMode;
 
-uint8_t playbackVceIdx;
+#ifdef TOMMY_PROFILE
+profile_t tommyProfile;
+#endif
 
-float resamplingFreq;
+#ifdef SUSTAIN_LOOP
+// Looks for the loop of a sample, the search state is shared as one capture
+// completes at a time
+static uint8_t sustainJob(void *pContext, int32_t *pBudget)
+{
+    if (sustain_run(&sustainLoop, pBudget)) {
+        return 1;
+    }
+    if (sustainLoop.stage == SUSTAIN_READY) {
+        sample_t *pSample = (sample_t *)pContext;
+        pSample->loopStart = sustainLoop.start;
+        pSample->loopEnd = sustainLoop.end;
+    }
+    return 0;
+}
+#endif
 
-dsp::BiQuad lpf;
+#ifdef SAMPLE_MIPMAP
+// Starts the copy at a level of a sample, its loop taken down with it
+static void beginMip(uint8_t k, uint8_t level)
+{
+    const sample_t *pSample = &samples[k];
+    uint32_t length = pSample->end;
+    for (uint8_t l = 0; l < level; l++) {
+        length = MIPMAP_LENGTH(length);
+    }
+    // Exact, the loop search keeps the loop on multiples of SUSTAIN_ALIGN
+    const uint32_t loopEnd = pSample->loopEnd >> level;
+    const uint32_t loopLength = (pSample->loopEnd - pSample->loopStart) >> level;
+    mipmap_begin(&mipBuilds[k], level ? pSample->pMip[level - 1] : pSample->pBuf, length,
+                 pSample->start >> level, loopEnd, loopLength, pSample->pMip[level]);
+}
+
+// Builds the copies of a sample one after the other, after its loop is done.
+// Notes pick each copy up once it is complete.
+static uint8_t mipJob(void *pContext, int32_t *pBudget)
+{
+    const uint8_t k = (uint8_t)((mipmap_t *)pContext - mipBuilds);
+    if (!mipBuilds[k].pDst) {
+        beginMip(k, 0);
+    }
+    if (mipmap_run(&mipBuilds[k], pBudget)) {
+        return 1;
+    }
+    if (++samples[k].mipLevels == MIP_LEVELS) {
+        return 0;
+    }
+    beginMip(k, samples[k].mipLevels);
+    return 1;
+}
+#endif
 
 void MODFX_INIT(uint32_t platform, uint32_t api)
 {
-    pBufSampling = &bufA[0]; 
-    pBufPlayback = &bufB[0];
+    (void)platform;
+    (void)api;
+    arena_reset(&arena, ARENALENGTH);
+    for (uint8_t k = 0; k < ARENA_SLOTS; k++) {
+        samples[k].isReady = 0;
+    }
+    samplingSlot = ARENA_NONE;
+    playbackSlot = ARENA_NONE;
+#ifdef SAMPLE_STREAM
+    samplingLoop = 0;
+#endif
 
     isSampling = 0;
 
     swapBuffers = 0;
 
     playbackBufLength = 0;
+    releaseFrames = RELEASEMAX;
 
-    dutySampleCount = 0;
+    pitchRxCount = 0;
 
     uint8_t j = NVOICES;
     while (j > 0) {
         j--;
-        playbackIdx[j] = BUFMAXLENGTH;
-        xfadePlaybackIdx[j] = BUFMAXLENGTH;
-        xfadePlaybackBufLen[j] = BUFMAXLENGTH;
+        voices[j].isActive = 0;
     }
+    activeVoiceCount = 0;
+    voiceAge = 0;
 
     sampleMode = SAMPLEMODE_NOTRIG;
+    samplingTrigPitch = PITCH_NONE;
 
     samplingBufLen = BUFMAXLENGTH;
-    lastSampledBufLength = BUFMAXLENGTH;
+    samplingGain = 1.f;
+#ifdef SAMPLE_TRIM
+    onset_reset(&samplingOnset);
+#endif
+#ifdef SUSTAIN_LOOP
+    sustainLoop.stage = SUSTAIN_IDLE;
+#endif
+#ifdef SAMPLE_JOBS
+    jobs_reset(&jobs);
+#endif
+
+    nextSamplingStep = RESAMPLINGRATE / 48000.f;
+    currentSamplingStep = nextSamplingStep;
+#ifdef LPFILTER_DECIMATE
+    decimator.step = 0;
+#endif
 
-    playbackVceIdx = 0;
+#ifdef TOMMY_PROFILE
+    profile_reset(&tommyProfile);
+#endif
+}
 
-    resamplingFreq = RESAMPLINGRATE;
-    samplingStep = resamplingFreq / 48000.f;
-    nextSamplingStep = samplingStep;
-    currentSamplingStep = samplingStep;
+static const float semitoneRatios[13] = {
+    1.f, 1.05946309f, 1.12246205f, 1.18920712f, 1.25992105f, 1.33483985f, 1.41421356f,
+    1.49830708f, 1.58740105f, 1.68179283f, 1.78179744f, 1.88774863f, 2.f
+};
 
+// 2^(dpitch / 12) for a pitch difference in 1/256 semitones, without a division
+static inline float pitchRatio(int32_t dpitch)
+{
+    const uint32_t biased = (uint32_t)(dpitch + 3072 * 16); // 16 octaves down, so it is positive
+    const uint32_t octave = biased / 3072;
+    const uint32_t rem = biased - octave * 3072;
+
+    f32_t ratio;
+    ratio.f = linintf((float)(rem & 0xff) * (1.f / 256.f), semitoneRatios[rem >> 8], semitoneRatios[(rem >> 8) + 1]);
+    ratio.i += (octave - 16) << 23;
+    return ratio.f;
 }
 
-void MODFX_PROCESS(const float *main_xn, float *main_yn,
-                   const float *sub_xn,  float *sub_yn,
-                   uint32_t frames)
+#ifdef PITCH_DETECT
+// The pitch difference of a ratio in 1/256 semitones, the inverse of pitchRatio
+static inline int32_t ratioPitch(float ratio)
+{
+    f32_t octave;
+    octave.f = ratio;
+    f32_t rem = octave;
+    rem.i = (rem.i & 0x007fffff) | (127UL << 23); // 1 to 2
+    uint32_t semitone = 0;
+    while (semitone < 11 && rem.f >= semitoneRatios[semitone + 1]) {
+        semitone++;
+    }
+    const float fine = (rem.f - semitoneRatios[semitone]) / (semitoneRatios[semitone + 1] - semitoneRatios[semitone]);
+    return ((int32_t)((octave.i >> 23) & 0xff) - 127) * 3072 + (int32_t)(semitone << 8) + (int32_t)(fine * 256.f + 0.5f);
+}
+
+// Keys the root of the sample to the pitch found in it, the preview and then the
+// refined one. Notes started before keep the root they had.
+static uint8_t pitchJob(void *pContext, int32_t *pBudget)
 {
- 
-  for (uint32_t i = 0; i < frames; i++) {
-    const float oscillatorSample = main_xn[i + i + 1];
+    pitch_t *pSearch = (pitch_t *)pContext;
+    const uint8_t more = pitch_run(pSearch, pBudget);
+    if (pSearch->period > 0.f) {
+        sample_t *pSample = &samples[pitchSlot];
+        const float freq = RESAMPLINGRATE * pSample->step / pSearch->period;
+        const int32_t pitch = (69 << 8) + ratioPitch(freq * (1.f / 440.f));
+        pSample->rootPitch = pitch < 0 ? 0 : (pitch > (127 << 8) ? (127 << 8) : pitch);
+    }
+    return more;
+}
+#endif
 
-    const float audioCleanedSample = (main_yn[i + i] - oscillatorSample);
- 
-    main_yn[i + i + 1] = 0;
-#ifdef STEREO_PING_PONG
-    main_yn[i + i] = 0;
+// Step ratio to phase increment, clamped so that a silly ratio (or a root of 0 Hz)
+// cannot overflow the accumulators
+static inline uint32_t toPhaseStep(float step)
+{
+    if (!(step < STEPMAX)) {
+        step = STEPMAX;
+    }
+    const uint32_t phaseStep = (uint32_t)(step * (float)PHASE_ONE + 0.5f);
+    return phaseStep ? phaseStep : 1;
+}
+
+// Takes a free voice, or steals the quietest one (the oldest on a tie) and
+// crossfades out of what it was playing.
+template <uint8_t VOICES>
+static inline voice_t *allocVoice(void)
+{
+    voice_t *pVoice;
+
+    if (activeVoiceCount < VOICES) {
+        uint8_t j = 0;
+        while (voices[j].isActive) {
+            j++;
+        }
+        pVoice = &voices[j];
+        pVoice->isActive = 1;
+        pVoice->xfade.env.stage = ENV_DONE;
+        activeVoices[activeVoiceCount++] = j;
+        return pVoice;
+    }
+
+    pVoice = &voices[activeVoices[0]];
+
+    for (uint8_t k = 1; k < activeVoiceCount; k++) {
+        voice_t *pCandidate = &voices[activeVoices[k]];
+        if (pCandidate->play.env.gain < pVoice->play.env.gain ||
+                (pCandidate->play.env.gain == pVoice->play.env.gain && pCandidate->age < pVoice->age)) {
+            pVoice = pCandidate;
+        }
+    }
+
+    // Fade out from where it is, without running past the end of its envelope
+    uint32_t xfadeFrames = env_framesLeft(&pVoice->play.env);
+    if (xfadeFrames > XFADELENGTH) {
+        xfadeFrames = XFADELENGTH;
+    }
+    pVoice->xfade = pVoice->play;
+    env_release(&pVoice->xfade.env, xfadeFrames);
+#ifdef TOMMY_PROFILE
+    profile_steal(&tommyProfile);
+#endif
+
+    return pVoice;
+}
+
+// Takes a slot for a recording of bufLen samples, returns the samples it holds. The
+// sample playing is kept, so the slot may be shorter. Voices still playing the
+// slots it lands on fade out, and pending work on them is dropped.
+static uint32_t allocSlot(uint32_t bufLen)
+{
+#ifdef SAMPLE_STREAM
+    // The ring is as long as the whole arena
+    const uint8_t keep = sampleMode == SAMPLEMODE_RETRIG ? ARENA_NONE : playbackSlot;
+#else
+    const uint8_t keep = playbackSlot;
+#endif
+    uint32_t dropped;
+    samplingSlot = arena_alloc(&arena, SLOTUNITS(bufLen), SLOTUNITS(BUFMINLENGTH), keep, &dropped);
+
+    for (uint8_t k = 0; k < ARENA_SLOTS; k++) {
+        if (dropped & (1UL << k)) {
+            samples[k].isReady = 0;
+#ifdef SAMPLE_JOBS
+            jobs_cancel(&jobs, samples[k].pBuf);
+#endif
+#ifdef PITCH_DETECT
+            jobs_cancel(&jobs, &samples[k]);
+#endif
+#ifdef SAMPLE_MIPMAP
+            jobs_cancel(&jobs, &mipBuilds[k]);
+#endif
+            if (k == playbackSlot) {
+                playbackSlot = ARENA_NONE;
+            }
+        }
+    }
+    for (uint8_t k = 0; k < activeVoiceCount; k++) {
+        voice_t *pVoice = &voices[activeVoices[k]];
+        if ((dropped & (1UL << pVoice->slot)) && env_framesLeft(&pVoice->play.env) > XFADELENGTH) {
+            env_release(&pVoice->play.env, XFADELENGTH);
+        }
+    }
+
+    sample_t *pSample = &samples[samplingSlot];
+    pSample->pBuf = &sampleMemory[arena.slots[samplingSlot].offset + (BUFGUARD ? MIX_TAPSBEFORE : 0)];
+    pSample->loopEnd = 0;
+    pSample->isReady = 0;
+#ifdef SAMPLE_MIPMAP
+    pSample->mipLevels = 0;
+#endif
+    for (uint8_t j = 1; j <= (BUFGUARD ? MIX_TAPSBEFORE : 0); j++) {
+        // Silence before the first sample, the guard after is never read at full level
+        pSample->pBuf[-(int32_t)j] = 0;
+    }
+    pBufSampling = pSample->pBuf;
+
+    const uint32_t units = arena.slots[samplingSlot].length;
+    return units < SLOTUNITS(bufLen) ? SLOTMAXLENGTH(units) : bufLen;
+}
+
+static inline void startSampling(uint16_t pitch, uint32_t bufLen)
+{
+    bufLen = allocSlot(bufLen);
+    samples[samplingSlot].rootPitch = pitch;
+
+    samplingPhase = 0;
+#ifdef SAMPLE_ADPCM
+    adpcm_encoderReset(&adpcmEncoder);
+#endif
+    samplingTrigPitch = pitch;
+    samplingBufLen = bufLen;
+    samplingWait = (sampleMode == SAMPLEMODE_SINGLETRIG);
+    samplingFade = 0;
+#ifdef SAMPLE_TRIM
+    if (sampleMode != SAMPLEMODE_RETRIG) {
+        samplingGain = 1.f;
+    } else if (samplingOnset.windows) {
+        // The feed is taken to go on at the level of the last capture
+        const float peak = (float)samplingOnset.peak * (1.f / SDIV) / samplingGain;
+        samplingGain = peak * LEVEL_CAPTUREGAINMAX > LEVEL_CAPTUREPEAK ? LEVEL_CAPTUREPEAK / peak : LEVEL_CAPTUREGAINMAX;
+    }
+    onset_reset(&samplingOnset);
+#endif
+    isSampling = 1;
+#ifdef TOMMY_PROFILE
+    profile_capture(&tommyProfile);
+#endif
+
+    currentSamplingStep = nextSamplingStep;
+    samplingPhaseStep = toPhaseStep(currentSamplingStep);
+#ifdef LPFILTER_DECIMATE
+    decim_reset(&decimator, currentSamplingStep);
+#else
+    lpf.flush();
+    lpf.mCoeffs.setFOLP(fx_tanpif(LPFILTER_CUTOFF * currentSamplingStep));
+#endif
+}
+
+#ifdef SAMPLE_STREAM
+// Starts recording around the ring, the notes play what is behind the write head
+static inline void startStream(uint16_t pitch)
+{
+    startSampling(pitch, RINGLENGTH);
+    samplingGain = 1.f;
+    samplingLoop = 1;
+    samplingLapped = 0;
+
+    sample_t *pSample = &samples[samplingSlot];
+    pSample->step = currentSamplingStep;
+    pSample->start = 0;
+    pSample->level = LEVEL_UNITY;
+}
+
+// Places a voice of step behind the write head of the ring: far enough back that it
+// never reaches samples not yet written (the recorder runs a span behind the voices),
+// near enough that the recorder does not come round to it. Notes long enough to break
+// either limit are shortened. False when the ring does not hold enough yet.
+static uint8_t placeStreamVoice(uint32_t step, uint32_t *pPhase, uint32_t *pFrames)
+{
+    const float readStep = (float)step * k_phase_recipf;
+    const float writeStep = (float)samplingPhaseStep * k_phase_recipf;
+    const float margin = (float)(MIX_TAPSAFTER + 2) + writeStep * MAXFRAMES;
+    const float drift = readStep > writeStep ? readStep - writeStep : writeStep - readStep;
+    const float room = (float)(RINGLENGTH - MIX_TAPSBEFORE) - 2.f * margin;
+
+    float frames = (float)(XFADELENGTH + releaseFrames);
+    if (frames * drift > room) {
+        frames = room / drift;
+    }
+
+    const uint32_t distance = (uint32_t)(margin + (readStep > writeStep ? drift * frames : 0.f)) + 1;
+    const uint32_t written = samplingLapped ? RINGLENGTH : (samplingPhase >> PHASE_FRACBITS);
+    if (distance > written) {
+        return 0;
+    }
+
+    const uint32_t back = distance << PHASE_FRACBITS;
+    *pPhase = samplingPhase >= back ? samplingPhase - back : samplingPhase + RINGPHASE - back;
+    *pFrames = (uint32_t)frames;
+    return 1;
+}
+#endif
+
+#ifdef SAMPLE_TRIM
+// Envelope level for the voices of a recording
+static inline int32_t normalLevel(const onset_t *pOnset)
+{
+    const float rms = onset_rms(pOnset) * (1.f / SDIV);
+    const float peak = (float)pOnset->peak * (1.f / SDIV);
+    float gain = LEVEL_GAINMAX;
+    if (rms * gain > LEVEL_RMS) {
+        gain = LEVEL_RMS / rms;
+    }
+    if (peak * gain > 1.f) {
+        gain = 1.f / peak;
+    }
+    return (int32_t)(gain * (float)LEVEL_UNITY);
+}
 #endif
-   
-   
-    if (oscillatorSample > NOISETHRESHOLD || oscillatorSample < -NOISETHRESHOLD) {
+
+// The sample a note plays: the last one recorded, or in a kit the one with the
+// nearest root (the newest of equals). None before the first recording.
+static inline const sample_t *findSample(uint16_t pitch)
+{
+#ifdef SAMPLE_STREAM
+    if (samplingLoop) {
+        return &samples[samplingSlot];
+    }
+#endif
+#ifdef SAMPLE_KIT
+    const sample_t *pFound = 0;
+    uint32_t nearest = 0;
+    uint32_t newest = 0;
+    for (uint8_t k = 0; k < ARENA_SLOTS; k++) {
+        if (!samples[k].isReady) {
+            continue;
+        }
+        const int32_t d = (int32_t)pitch - samples[k].rootPitch;
+        const uint32_t distance = d < 0 ? -d : d;
+        const uint32_t serial = arena.slots[k].serial;
+        if (!pFound || distance < nearest || (distance == nearest && serial > newest)) {
+            pFound = &samples[k];
+            nearest = distance;
+            newest = serial;
+        }
+    }
+    return pFound;
+#else
+    (void)pitch;
+    return playbackSlot != ARENA_NONE ? &samples[playbackSlot] : 0;
+#endif
+}
+
+template <bool PINGPONG, uint8_t VOICES>
+__attribute__((noinline)) static void trigger(uint16_t pitch)
+{
+#ifdef SAMPLE_JOBS
+    // Held back while the jobs on the last recording run in the background, the
+    // notes play the one before and no new recording starts until then
+    if (swapBuffers && !jobs_pending(&jobs, pBufSampling))
+#else
+    if (swapBuffers)
+#endif
+    {
+        // The last recording is done, notes play it from here on
+        samples[samplingSlot].isReady = 1;
+        playbackSlot = samplingSlot;
+        swapBuffers = 0;
+    }
+
+#ifdef SAMPLE_STREAM
+    if (sampleMode == SAMPLEMODE_RETRIG && !swapBuffers && (!samplingLoop || samplingTrigPitch == PITCH_NONE)) {
+        startStream(pitch);
+    }
+#endif
+
+    if (!isSampling && !swapBuffers) {
+        if (sampleMode == SAMPLEMODE_SINGLETRIG) {
+#ifdef SAMPLE_KIT
+            startSampling(pitch, playbackBufLength > BUFMINLENGTH ? playbackBufLength : BUFMINLENGTH);
+#else
+            startSampling(pitch, SINGLELENGTH);
+#endif
+
+        } else if (sampleMode == SAMPLEMODE_RETRIG && 
+                (samplingTrigPitch == PITCH_NONE || (samplingTrigPitch >> 8) == (pitch >> 8))) {
+            startSampling(pitch, playbackBufLength);
+        }
+    }
     
-        if (oscillatorSample > NOISETHRESHOLD) {
-            dutySampleCount++;
+    if (sampleMode != SAMPLEMODE_SINGLETRIG) {
+        const sample_t *pSample = findSample(pitch);
+        if (!pSample) {
+            return;
+        }
+
+        uint32_t step = toPhaseStep(pitchRatio((int32_t)pitch - pSample->rootPitch) * pSample->step);
+        uint32_t phase = pSample->start << PHASE_FRACBITS;
+        uint32_t loopEnd = 0;
+        uint32_t loopLength = 0;
+        uint32_t frames;
+#ifdef SAMPLE_STREAM
+        if (samplingLoop) {
+            if (!placeStreamVoice(step, &phase, &frames)) {
+                return;
+            }
+            // Voices in the ring go round, a sample is only ever as long as the ring
+            loopEnd = RINGPHASE;
+            loopLength = RINGPHASE;
+        } else
+#endif
+        if (pSample->loopEnd) {
+            loopEnd = pSample->loopEnd << PHASE_FRACBITS;
+            loopLength = (pSample->loopEnd - pSample->loopStart) << PHASE_FRACBITS;
+            frames = XFADELENGTH + releaseFrames;
+        } else {
+            frames = mix_framesUntil(phase, pSample->end << PHASE_FRACBITS, step);
+        }
+        if (!frames) {
+            // Nothing above the noise was recorded
+            return;
+        }
+
+        store_t *pBuf = pSample->pBuf;
+#ifdef SAMPLE_MIPMAP
+        // Above the root a copy at half (or a quarter) of the rate keeps the step at
+        // or below one, the voice reads it at the same time scale
+        for (uint8_t l = 0; l < pSample->mipLevels && step > PHASE_ONE; l++) {
+            pBuf = pSample->pMip[l];
+            step >>= 1;
+            phase >>= 1;
+            loopEnd >>= 1;
+            loopLength >>= 1;
+        }
+#endif
+
+        voice_t *pVoice = allocVoice<VOICES>();
+
+        pVoice->play.step = step;
+        pVoice->play.phase = phase;
+        pVoice->play.loopEnd = loopEnd;
+        pVoice->play.loopLength = loopLength;
+        pVoice->play.pBuf = pBuf;
+        pVoice->slot = (uint8_t)(pSample - samples);
+#ifdef SAMPLE_ADPCM
+        adpcm_cursorReset(&pVoice->play.cursor);
+#endif
+        env_start(&pVoice->play.env, XFADELENGTH, releaseFrames, frames, pSample->level);
+
+        pVoice->age = voiceAge++;
+        pVoice->pitch = pitch;
+        pVoice->channel = PINGPONG ? (pVoice->age & 1) : 1;
+    }
+}
+
+// A note that is let go fades out quickly, its voices are free again once silent
+static void noteOff(uint16_t pitch)
+{
+    for (uint8_t k = 0; k < activeVoiceCount; k++) {
+        voice_t *pVoice = &voices[activeVoices[k]];
+        if ((pVoice->pitch >> 8) == (pitch >> 8) && env_framesLeft(&pVoice->play.env) > NOTEOFFLENGTH) {
+            env_release(&pVoice->play.env, NOTEOFFLENGTH);
         }
+    }
+}
 
-    } else {
-        if (dutySampleCount > (48000 / 1760)) {
+#ifdef SAMPLE_ADPCM
+#define MIXVOICE(pMix, pBuf, cursor, phase, step, gain, gainInc, frames) \
+    mixAdpcm(pMix, pBuf, &(cursor), phase, step, gain, gainInc, frames)
+#elif defined(VOICE_WINDOW)
+#define MIXVOICE(pMix, pBuf, cursor, phase, step, gain, gainInc, frames) \
+    mixWindow(pMix, pBuf, phase, step, gain, gainInc, frames)
+#else
+#define MIXVOICE(pMix, pBuf, cursor, phase, step, gain, gainInc, frames) \
+    mixVoice(pMix, pBuf, phase, step, gain, gainInc, frames)
+#endif
+
+#ifndef SAMPLE_ADPCM
+// One copy of each interpolation kernel, picked from the step
+__attribute__((noinline)) static uint32_t mixVoice(int32_t *pMix, const int16_t *pBuf, uint32_t phase, uint32_t step,
+                                                   int32_t gain, int32_t gainInc, uint32_t frames)
+{
+    // At the root on whole samples there is nothing to interpolate, the samples
+    // are played as recorded rather than through the sinc low pass
+    if (step == PHASE_ONE && !(phase & PHASE_FRACMASK)) {
+        return mixQ15(pMix, pBuf, phase, step, gain, gainInc, frames);
+    }
+#ifdef INTERP_SINC
+    if (step <= (uint32_t)(INTERP_SINC_MAXSTEP * PHASE_ONE)) {
+        return mixSinc(pMix, pBuf, phase, step, gain, gainInc, frames);
+    }
+#endif
+    if (step <= (uint32_t)(INTERP_HERMITE_MAXSTEP * PHASE_ONE)) {
+        return mixHermite(pMix, pBuf, phase, step, gain, gainInc, frames);
+    }
+    return mixQ15(pMix, pBuf, phase, step, gain, gainInc, frames);
+}
+
+#ifdef VOICE_WINDOW
+// The samples read in one pass at WINDOW_MAXSTEP, and one more to word align the copy
+#define WINDOWLENGTH ((MAXFRAMES - 1) * WINDOW_MAXSTEP + MIX_TAPSBEFORE + MIX_TAPSAFTER + 2)
+
+int16_t voiceWindow[WINDOWLENGTH] __attribute__((aligned(4))); // the voices take turns
+
+// Copies the taps of all frames to the window, then runs the kernel on the copy
+// with the phase moved to match
+static inline uint32_t mixWindow(int32_t *pMix, const int16_t *pBuf, uint32_t phase, uint32_t step,
+                                 int32_t gain, int32_t gainInc, uint32_t frames)
+{
+    if (step > WINDOW_MAXSTEP * PHASE_ONE || frames > MAXFRAMES) {
+        return mixVoice(pMix, pBuf, phase, step, gain, gainInc, frames);
+    }
+    const int32_t first = (int32_t)(phase >> PHASE_FRACBITS) - MIX_TAPSBEFORE; // in the guard before sample 0
+    const int32_t last = (int32_t)((phase + (frames - 1) * step) >> PHASE_FRACBITS) + MIX_TAPSAFTER;
+    const int32_t lead = ((uintptr_t)&pBuf[first] & 2) >> 1;
+    mix_loadSamples(&voiceWindow[lead], &pBuf[first], last - first + 1);
+    const uint32_t base = (uint32_t)(first - lead) << PHASE_FRACBITS;
+    return mixVoice(pMix, voiceWindow, phase - base, step, gain, gainInc, frames) + base;
+}
+#endif
+#endif
 
-            if (swapBuffers) {
-                int16_t *pTemp = pBufSampling;
-                pBufSampling = pBufPlayback;
-                pBufPlayback = pTemp;
-                swapBuffers = 0;
-                playbackRootFreq = samplingRootFreq;
-                lastSampledBufLength = samplingBufLen;
+// Mixes up to frames frames of a sound a voice plays, with one kernel call per
+// envelope segment. One copy for the voices and the sounds they crossfade out of.
+__attribute__((noinline)) static void mixEnvelope(int32_t *pMix, voice_play_t *pPlay, uint32_t frames)
+{
+    const store_t *pBuf = pPlay->pBuf;
+    const uint32_t step = pPlay->step;
+    const uint32_t loopEnd = pPlay->loopEnd;
+    const uint32_t loopLength = pPlay->loopLength;
+    env_t *pEnv = &pPlay->env;
+    uint32_t phase = pPlay->phase;
+
+    while (frames && pEnv->stage != ENV_DONE) {
+        uint32_t n = frames < pEnv->frames ? frames : pEnv->frames;
+        if (loopLength) {
+            while (phase >= loopEnd) {
+                phase -= loopLength;
+            }
+            const uint32_t loopFrames = mix_framesUntil(phase, loopEnd, step);
+            if (n > loopFrames) {
+                n = loopFrames;
             }
+        }
+        phase = MIXVOICE(pMix, pBuf, pPlay->cursor, phase, step, pEnv->gain, pEnv->inc, n);
+        env_advance(pEnv, n);
+        pMix += n + n;
+        frames -= n;
+    }
 
-            const float freq = 1.f / ((float)dutySampleCount * (1.f / 48000.f));
+    pPlay->phase = phase;
+}
 
-            if (!isSampling) {
-                if (sampleMode == SAMPLEMODE_SINGLETRIG) {
-                    samplingIdx = 0;
-                    samplingTrigFreq = freq;  
-                    samplingRootFreq = freq;
-                    samplingBufLen = BUFMAXLENGTH;
-                    isSampling = 1;
-
-                    currentSamplingStep = nextSamplingStep;
-
-                    lpf.flush();
-                    float wc = lpf.mCoeffs.wc(resamplingFreq, (1.f / 48000.f));
-                    //lpf.mCoeffs.setSOLP(fx_tanpif(wc), 1.41421356237);
-                    lpf.mCoeffs.setFOLP(fx_tanpif(wc));
-                   
-
-                } else if (sampleMode == SAMPLEMODE_RETRIG && 
-                        (!samplingTrigFreq ||
-                        (samplingTrigFreq > (freq - 0.5) && samplingTrigFreq < (freq + 0.5)))) {
-
-                    samplingIdx = 0;
-                    samplingTrigFreq = freq;    
-                    samplingRootFreq = freq;
-                    samplingBufLen = playbackBufLength;
-                    isSampling = 1;
-
-                    currentSamplingStep = nextSamplingStep;
-
-                    lpf.flush();
-                    float wc = lpf.mCoeffs.wc(resamplingFreq, (1.f / 48000.f));
-                    //lpf.mCoeffs.setSOLP(fx_tanpif(wc), 1.41421356237);
-                    lpf.mCoeffs.setFOLP(fx_tanpif(wc));
-                    
-                }
+// Renders frames [start, end) of the active voices into the mix buffer, one voice at a time,
+// with a stolen voice fading out under the attack. Voices leave the active list when their
+// envelope is done, the envelope ends at or before the end of the sample.
+__attribute__((noinline)) static void renderVoices(int32_t *mix, uint32_t start, uint32_t end)
+{
+    uint8_t k = activeVoiceCount;
+
+    while (k > 0) {
+        k--;
+        voice_t *pVoice = &voices[activeVoices[k]];
+        int32_t *pMix = &mix[start + start + pVoice->channel];
+
+        if (pVoice->xfade.env.stage != ENV_DONE) {
+            mixEnvelope(pMix, &pVoice->xfade, end - start);
+        }
+        mixEnvelope(pMix, &pVoice->play, end - start);
+
+        if (pVoice->play.env.stage == ENV_DONE) {
+            pVoice->isActive = 0;
+            activeVoices[k] = activeVoices[--activeVoiceCount];
+        }
+    }
+}
+
+// Converts the mixed voices of frames [start, end) to the output
+template <bool PINGPONG>
+__attribute__((noinline)) static void mixOut(float *main_yn, const int32_t *mix, uint32_t start, uint32_t end)
+{
+    for (uint32_t i = start; i < end; i++) {
+        if (PINGPONG) {
+            main_yn[i + i] = (float)mix[i + i] * k_mix_scalef;
+        }
+        main_yn[i + i + 1] = (float)mix[i + i + 1] * k_mix_scalef;
+    }
+}
+
+// Records frames [start, end), returns the frame at which the recording completed (or end).
+// With FILTER below the full rate the input is low passed and point sampled, or with
+// LPFILTER_DECIMATE each stored sample is computed once by the decimator. Without it
+// (or at the full rate) the input is point sampled as it is. A single trigger capture
+// waits for the signal to rise above the noise, a streaming one goes round the ring
+// until it is stopped.
+template <bool FILTER>
+__attribute__((noinline)) static uint32_t record(const float *audio, uint32_t start, uint32_t end)
+{
+    if (!isSampling) {
+        return end;
+    }
+
+    uint32_t i = start;
+
+    if (samplingWait) {
+        for (; i < end; i++) {
+            if (audio[i] > 0.01 || audio[i] < -0.01) {
+                samplingWait = 0;
+                break;
             }
-            
-            if (sampleMode != SAMPLEMODE_SINGLETRIG) {
-
-                xfadePlaybackStep[playbackVceIdx] = playbackStep[playbackVceIdx];
-                xfadePlaybackIdx[playbackVceIdx] = playbackIdx[playbackVceIdx];
-                xfadeLastGain[playbackVceIdx] = 1.f - playbackIdx[playbackVceIdx] / playbackBufLen[playbackVceIdx];
-                xfadePlaybackBufLen[playbackVceIdx] = playbackBufLen[playbackVceIdx];
-                pXfadePlaybackBuf[playbackVceIdx] = pPlaybackBuf[playbackVceIdx];
-
-                playbackStep[playbackVceIdx] = freq / playbackRootFreq * samplingStep;
-                playbackIdx[playbackVceIdx] = 0; 
-                pPlaybackBuf[playbackVceIdx] = pBufPlayback;
-
-                if (sampleMode == SAMPLEMODE_RETRIG) {
-                    playbackBufLen[playbackVceIdx] = lastSampledBufLength;
-                } else {
-                    playbackBufLen[playbackVceIdx] = playbackBufLength;
+        }
+    }
+
+    uint32_t phase = samplingPhase;
+    const bool filter = FILTER && samplingPhaseStep < PHASE_ONE;
+#ifdef LPFILTER_DECIMATE
+    const uint32_t step = filter ? PHASE_ONE : samplingPhaseStep;
+#else
+    const uint32_t step = samplingPhaseStep;
+#endif
+    // The fade-in rises to the capture gain
+    const float gain = samplingGain;
+    const float fadeInc = (float)step * (gain / XFADEPHASE);
+    float fade = samplingFade;
+#ifdef SAMPLE_STREAM
+    const uint8_t loop = samplingLoop;
+    const uint32_t endPhase = loop ? RINGPHASE - 1 : samplingBufLen << PHASE_FRACBITS;
+#else
+    const uint32_t endPhase = samplingBufLen << PHASE_FRACBITS;
+#endif
+    store_t *pBuf = pBufSampling;
+#ifdef SAMPLE_ADPCM
+    adpcm_encoder_t encoder = adpcmEncoder;
+#else
+    // The samples go to SRAM first and to the SDRAM in words, once per call
+    int16_t stage[MAXFRAMES];
+    uint32_t stageFirst = phase >> PHASE_FRACBITS;
+    uint32_t stageCount = 0;
+#endif
+#ifdef SAMPLE_TRIM
+    onset_t onset = samplingOnset;
+#endif
+
+    for (; i < end; i++) {
+        // Indices up to bufLen are written, the last one is only read by the interpolation
+        if (phase > endPhase) {
+#ifdef SAMPLE_STREAM
+            if (loop) {
+                mix_storeSamples(&pBuf[stageFirst], stage, stageCount);
+                phase -= RINGPHASE;
+                stageFirst = phase >> PHASE_FRACBITS;
+                stageCount = 0;
+                samplingLapped = 1;
+            } else
+#endif
+            {
+#ifdef SAMPLE_ADPCM
+                adpcm_flush(&encoder, pBuf);
+#endif
+                sample_t *pSample = &samples[samplingSlot];
+                pSample->step = currentSamplingStep;
+#ifdef SAMPLE_TRIM
+                // Trimmed to the sound, the slot hands the rest of its room to the next one
+                onset_finish(&onset, samplingBufLen);
+                pSample->start = onset.start;
+                pSample->end = onset.end;
+                pSample->level = normalLevel(&onset);
+                arena_shrink(&arena, samplingSlot, SLOTUNITS(onset.end));
+#else
+                pSample->start = 0;
+                pSample->end = samplingBufLen;
+                pSample->level = LEVEL_UNITY;
+#endif
+                // A job the full queue refuses leaves the sample without what it finds
+#ifdef SUSTAIN_LOOP
+                sustain_begin(&sustainLoop, pBuf, pSample->start, pSample->end);
+                jobs_add(&jobs, sustainJob, pSample, pBuf);
+#endif
+#ifdef PITCH_DETECT
+                // Not tagged with the buffer, notes play with the trigger note as the root
+                // until the preview is found
+                pitch_begin(&pitchSearch, pBuf, pSample->start, pSample->end, RESAMPLINGRATE * currentSamplingStep);
+                pitchSlot = samplingSlot;
+                jobs_add(&jobs, pitchJob, &pitchSearch, pSample);
+#endif
+#ifdef SAMPLE_MIPMAP
+                // The copies follow the sample in its slot, each with its own guards
+                store_t *pMip = pBuf;
+                uint32_t mipLength = pSample->end;
+                for (uint8_t l = 0; l < MIP_LEVELS; l++) {
+                    pMip += BASEUNITS(mipLength);
+                    mipLength = MIPMAP_LENGTH(mipLength);
+                    pSample->pMip[l] = pMip;
                 }
+                // Begun by the job once the loop is in place. Not tagged with the
+                // buffer, so playback starts without waiting for them.
+                mipBuilds[samplingSlot].pDst = 0;
+                jobs_add(&jobs, mipJob, &mipBuilds[samplingSlot], &mipBuilds[samplingSlot]);
+#endif
+
+                isSampling = 0;
+                swapBuffers = 1;
 
-                playbackVceIdx++;
-                if (playbackVceIdx >= NVOICES) {
-                    playbackVceIdx = 0;
+                if (sampleMode == SAMPLEMODE_SINGLETRIG) {
+                    sampleMode = SAMPLEMODE_NOTRIG;    
                 }
+                break;
             }
-
         }
-        dutySampleCount = 0;
-    }
 
-    uint8_t j = NVOICES;
+        float in = audio[i];
+#ifdef LPFILTER_DECIMATE
+        if (filter && !decim_process(&decimator, in, &in)) {
+            continue;
+        }
+#else
+        if (filter) {
+            in = lpf.process_fo(in);
+        }
+#endif
 
-    while (j > 0) {
-        j--;
-        if (playbackIdx[j] < playbackBufLen[j]) {
-            if (playbackIdx[j] > 128.f) {
-                const float d = (1 - ((playbackIdx[j] - 128.f) / (float)(playbackBufLen[j] - 128)));
-                const uint16_t playbackIdxInt = playbackIdx[j];
-                const float fr = playbackIdx[j] - playbackIdxInt;
+        const int16_t sample = mix_ssat16((int32_t)(in * fade * (float)SDIV));
+        if (fade < gain) {
+            fade += fadeInc;
+            if (fade > gain) {
+                fade = gain;
+            }
+        }
+        const uint32_t idx = phase >> PHASE_FRACBITS;
+#ifdef SAMPLE_ADPCM
+        adpcm_put(&encoder, pBuf, idx, sample);
+#else
+        // A point sampled recording below the rate may write an index twice
+        stage[idx - stageFirst] = sample;
+        stageCount = idx - stageFirst + 1;
+#endif
+#ifdef SAMPLE_STREAM
+        if (loop) {
+            // The guards either side of the ring repeat the other end for the interpolation
+            if (idx < MIX_TAPSAFTER) {
+                pBuf[idx + RINGLENGTH] = sample;
+            } else if (idx >= RINGLENGTH - MIX_TAPSBEFORE) {
+                pBuf[(int32_t)idx - RINGLENGTH] = sample;
+            }
+        } else
+#endif
+        {
+#ifdef SAMPLE_TRIM
+            onset_push(&onset, sample, idx);
+#endif
+        }
+        phase += step;
+    }
 
-                const float sample = ((float)pPlaybackBuf[j][playbackIdxInt] * (1.0 - fr)) + ((float)pPlaybackBuf[j][playbackIdxInt + 1] * fr);
-#ifdef STEREO_PING_PONG
-                main_yn[i + i + (j & 1)] += ((sample / (float)SDIV) * d);
+#ifdef SAMPLE_ADPCM
+    adpcmEncoder = encoder;
 #else
-                main_yn[i + i + 1] += (sample / (float)SDIV) * d;
+    mix_storeSamples(&pBuf[stageFirst], stage, stageCount);
+#endif
+#ifdef SAMPLE_TRIM
+    samplingOnset = onset;
 #endif
+    samplingFade = fade;
+    samplingPhase = phase;
+    return i;
+}
 
-            } else {
-                const uint16_t playbackIdxInt = playbackIdx[j];
-                const float fr = playbackIdx[j] - playbackIdxInt;
+template <uint8_t MODE, bool PINGPONG>
+static inline void route(float *main_yn, const float *audio, uint32_t start, uint32_t end)
+{
+    if (MODE == SAMPLEMODE_SINGLETRIG) {
+        // Armed, the incoming audio is passed through the left channel
+        for (uint32_t i = start; i < end; i++) {
+            main_yn[i + i] = audio[i];
+        }
+    } else if (!PINGPONG) {
+        for (uint32_t i = start; i < end; i++) {
+            main_yn[i + i] = main_yn[i + i + 1];
+        }
+    }
+}
 
-                float sample = ((float)pPlaybackBuf[j][playbackIdxInt] * (1.0 - fr)) + ((float)pPlaybackBuf[j][playbackIdxInt + 1] * fr);
+// Renders and records frames [start, end). A single trigger capture that completes
+// (leaving mode) moves *pRouteEnd, the remaining frames of the block are routed as NOTRIG.
+template <bool PINGPONG, bool FILTER>
+static inline void renderSpan(float *main_yn, int32_t *mix, const float *audio, uint32_t start, uint32_t end,
+                              uint8_t mode, uint32_t *pRouteEnd)
+{
+    renderVoices(mix, start, end);
+    mixOut<PINGPONG>(main_yn, mix, start, end);
+    const uint32_t recordEnd = record<FILTER>(audio, start, end);
 
-                if (xfadePlaybackStep[j] < xfadePlaybackBufLen[j]) {
-                    const float d = xfadeLastGain[j] * (1.0 - (playbackIdx[j] / 128.f));
-                    
-                    const uint16_t playbackIdxInt = xfadePlaybackIdx[j];
-                    const float fr = xfadePlaybackIdx[j] - playbackIdxInt;
+    if (sampleMode != mode && recordEnd < *pRouteEnd) {
+        *pRouteEnd = recordEnd;
+    }
+}
 
-                    sample = sample + (((float)pXfadePlaybackBuf[j][playbackIdxInt] * (1.0 - fr)) + ((float)pXfadePlaybackBuf[j][playbackIdxInt + 1] * fr)) * d;
+static inline uint8_t overlaps(uint32_t readPhase, uint32_t readStep, uint32_t writePhase, uint32_t writeStep, uint32_t frames)
+{
+    const uint32_t readIdx = readPhase >> PHASE_FRACBITS;
+    const uint32_t writeIdx = writePhase >> PHASE_FRACBITS;
+    return (readIdx <= writeIdx + ((writeStep * frames) >> PHASE_FRACBITS) + 1 + BUFGUARD) &&
+           (writeIdx <= readIdx + ((readStep * frames) >> PHASE_FRACBITS) + 2 + BUFGUARD);
+}
 
-                    xfadePlaybackIdx[j] += xfadePlaybackStep[j];
+// True when a voice may read samples the recorder writes within the next frames,
+// these spans are rendered frame by frame to keep the read/write order.
+static uint8_t readsRecording(uint32_t frames)
+{
+    if (!isSampling) {
+        return 0;
+    }
+#ifdef SAMPLE_STREAM
+    if (samplingLoop) {
+        // Voices in the ring are placed clear of the write head
+        return 0;
+    }
+#endif
 
+    for (uint8_t k = 0; k < activeVoiceCount; k++) {
+        const voice_t *pVoice = &voices[activeVoices[k]];
+        if (pVoice->play.pBuf == pBufSampling &&
+                overlaps(pVoice->play.phase, pVoice->play.step, samplingPhase, samplingPhaseStep, frames)) {
+            return 1;
+        }
+        if (pVoice->xfade.pBuf == pBufSampling && pVoice->xfade.env.stage != ENV_DONE &&
+                overlaps(pVoice->xfade.phase, pVoice->xfade.step, samplingPhase, samplingPhaseStep, frames)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Renders and records the spans between the triggers of a block and plays the
+// triggers. Returns the frame the block is routed in its sample mode up to, the
+// mode only changes inside a block when a single trigger capture completes. One
+// copy for all the sample modes, only the routing differs.
+template <bool PINGPONG, uint8_t VOICES, bool FILTER>
+__attribute__((noinline)) static uint32_t renderTriggers(float *main_yn, int32_t *mix, const float *audio,
+                                                         const trigger_t *triggers, uint8_t triggerCount,
+                                                         uint32_t blockFrames)
+{
+    const uint8_t mode = sampleMode;
+    uint32_t routeEnd = blockFrames;
+
+    // Render the spans between the triggers
+    uint32_t start = 0;
+    for (uint8_t t = 0; t <= triggerCount; t++) {
+        const uint32_t end = (t < triggerCount) ? triggers[t].frame : blockFrames;
+
+        if (end > start) {
+            if (readsRecording(end - start)) {
+                for (uint32_t i = start; i < end; i++) {
+                    renderSpan<PINGPONG, FILTER>(main_yn, mix, audio, i, i + 1, mode, &routeEnd);
+                }
+            } else {
+                renderSpan<PINGPONG, FILTER>(main_yn, mix, audio, start, end, mode, &routeEnd);
+            }
+        }
+
+        if (t < triggerCount) {
+            if (triggers[t].isOff) {
+                noteOff(triggers[t].pitch);
+            } else {
+#ifdef TOMMY_PROFILE
+                const uint32_t age = voiceAge;
+                trigger<PINGPONG, VOICES>(triggers[t].pitch);
+                if (voiceAge != age) {
+                    profile_note(&tommyProfile);
                 }
-#ifdef STEREO_PING_PONG                
-                main_yn[i + i + (j & 1)] += (sample / (float)SDIV);
 #else
-                main_yn[i + i + 1] += (sample / (float)SDIV);
+                trigger<PINGPONG, VOICES>(triggers[t].pitch);
 #endif
             }
-            playbackIdx[j] += playbackStep[j];
+            start = end;
         }
     }
+    return routeEnd;
+}
 
-    if (isSampling && (samplingIdx > 0 || sampleMode != SAMPLEMODE_SINGLETRIG || audioCleanedSample > 0.01 || audioCleanedSample < -0.01)) {
-        
-        float d = 1;
-        if (samplingIdx < 128) {
-            d = ((float)samplingIdx / 128.f);
-        }
+// Renders one block for a sample mode, routing, voice count and filter setting.
+// From where a single trigger capture completes the block is routed as NOTRIG.
+template <uint8_t MODE, bool PINGPONG, uint8_t VOICES, bool FILTER>
+static void renderBlock(float *main_yn, int32_t *mix, const float *audio,
+                        const trigger_t *triggers, uint8_t triggerCount, uint32_t blockFrames)
+{
+    if (!triggerCount && !activeVoiceCount && !isSampling) {
+        // Nothing playing or recording, only the routing is left
+        mixOut<PINGPONG>(main_yn, mix, 0, blockFrames);
+        route<MODE, PINGPONG>(main_yn, audio, 0, blockFrames);
+        return;
+    }
 
-#ifdef LPFILTER
-        pBufSampling[(uint32_t)samplingIdx] = (int16_t) ((lpf.process_fo(audioCleanedSample) * d) * (float)SDIV); 
-//        pBufSampling[(uint32_t)samplingIdx] = (int16_t) ((lpf.process_so(audioCleanedSample) * d) * (float)SDIV); 
+    const uint32_t routeEnd = renderTriggers<PINGPONG, VOICES, FILTER>(main_yn, mix, audio, triggers, triggerCount,
+                                                                        blockFrames);
+    route<MODE, PINGPONG>(main_yn, audio, 0, routeEnd);
+    if (MODE == SAMPLEMODE_SINGLETRIG) {
+        route<SAMPLEMODE_NOTRIG, PINGPONG>(main_yn, audio, routeEnd, blockFrames);
+    }
+}
 
-#else
-        pBufSampling[(uint32_t)samplingIdx] = (int16_t) ((audioCleanedSample * d) * (float)SDIV); 
+void MODFX_PROCESS(const float *main_xn, float *main_yn,
+                   const float *sub_xn,  float *sub_yn,
+                   uint32_t frames)
+{
+  (void)sub_xn;
+  (void)sub_yn;
+  float audio[MAXFRAMES];
+  int32_t mix[MAXFRAMES * 2];
+  trigger_t triggers[MAXTRIGGERS];
+
+#ifdef TOMMY_PROFILE
+  const uint32_t profileFrames = frames;
+  profile_begin(&tommyProfile);
 #endif
-        if (samplingIdx > samplingBufLen) {
-            samplingStep = currentSamplingStep;
 
-            isSampling = 0;
-            swapBuffers = 1;
+  while (frames) {
+    const uint32_t blockFrames = frames > MAXFRAMES ? MAXFRAMES : frames;
+    uint8_t triggerCount = 0;
+
+    // Scan the oscillator channel for pitch frames
+    for (uint32_t i = 0; i < blockFrames; i++) {
+        const float oscillatorSample = main_xn[i + i + 1];
 
-            if (sampleMode == SAMPLEMODE_SINGLETRIG) {
-                sampleMode = SAMPLEMODE_NOTRIG;    
+        audio[i] = (main_yn[i + i] - oscillatorSample);
+
+        mix[i + i] = 0;
+        mix[i + i + 1] = 0;
+
+        if (pitchRxCount) {
+            if (pitchRxCount <= PITCHFRAME_BITS) {
+                pitchRxBits = (pitchRxBits << 1) | (oscillatorSample > 0);
+                pitchRxCount++;
+            } else {
+                // A frame without its silent guard sample is out of sync, drop it
+                if (!(oscillatorSample > NOISETHRESHOLD) && !(oscillatorSample < -NOISETHRESHOLD)) {
+                    triggers[triggerCount].frame = i;
+                    triggers[triggerCount].pitch = (uint16_t)pitchRxBits;
+                    triggers[triggerCount].isOff = pitchRxOff;
+                    triggerCount++;
+                }
+                pitchRxCount = 0;
             }
-        } else {
-            samplingIdx += currentSamplingStep;
+        } else if (oscillatorSample > NOISETHRESHOLD || oscillatorSample < -NOISETHRESHOLD) {
+            pitchRxBits = 0;
+            pitchRxCount = 1;
+            pitchRxOff = oscillatorSample < 0;
         }
     }
 
-    if (sampleMode == SAMPLEMODE_SINGLETRIG) {
-        main_yn[i + i] = audioCleanedSample;
-    } else {
-#ifndef STEREO_PING_PONG
-        main_yn[i + i] =  main_yn[i + i + 1];
-#endif
+    // Dispatch once per block to the render core for the current sample mode
+    switch (sampleMode) {
+        case SAMPLEMODE_SINGLETRIG:
+            renderBlock<SAMPLEMODE_SINGLETRIG, k_pingPong, NVOICES, k_lpFilter>(main_yn, mix, audio, triggers, triggerCount, blockFrames);
+            break;
+        case SAMPLEMODE_RETRIG:
+            renderBlock<SAMPLEMODE_RETRIG, k_pingPong, NVOICES, k_lpFilter>(main_yn, mix, audio, triggers, triggerCount, blockFrames);
+            break;
+        default:
+            renderBlock<SAMPLEMODE_NOTRIG, k_pingPong, NVOICES, k_lpFilter>(main_yn, mix, audio, triggers, triggerCount, blockFrames);
+            break;
     }
+
+#ifdef SAMPLE_JOBS
+    // Background work gets a bounded slice after the block
+#ifdef TOMMY_PROFILE
+    const uint32_t jobStart = profile_ticks();
+    profile_jobs(&tommyProfile, jobStart, jobs_tick(&jobs, blockFrames));
+#else
+    jobs_tick(&jobs, blockFrames);
+#endif
+#endif
+
+    main_xn += blockFrames * 2;
+    main_yn += blockFrames * 2;
+    frames -= blockFrames;
   }
 
+#ifdef TOMMY_PROFILE
+  profile_end(&tommyProfile, profileFrames, activeVoiceCount);
+#endif
 }
 
 void MODFX_PARAM(uint8_t index, int32_t value)
@@ -318,25 +1378,35 @@ void MODFX_PARAM(uint8_t index, int32_t value)
   float valf = q31_to_f32(value);
   switch (index) {
     case k_user_modfx_param_time:
+        // Release time for new notes (finer towards the short end), and the
+        // length of a re-trigger capture
         playbackBufLength = BUFMINLENGTH + ((BUFMAXLENGTH - BUFMINLENGTH) * valf);
+        releaseFrames = RELEASEMIN + (uint32_t)((float)(RELEASEMAX - RELEASEMIN) * valf * valf);
         break;
 
     case k_user_modfx_param_depth:
+        // Stored rate from 3900 Hz up to the full 48000 Hz towards either end
         if (valf < 0.5) {
             sampleMode = SAMPLEMODE_SINGLETRIG;
-            resamplingFreq = (1.0 - (valf / 0.5)) * 44100.f;
-            nextSamplingStep = (resamplingFreq + (48000.f - 44100.f)) / 48000.f;
-            resamplingFreq *= 0.5;
+            nextSamplingStep = ((1.0 - (valf / 0.5)) * 44100.f + (48000.f - 44100.f)) / 48000.f;
         } else if (valf > 0.5) {
             sampleMode = SAMPLEMODE_RETRIG;
-            samplingTrigFreq = 0;
+            samplingTrigPitch = PITCH_NONE;
             valf -= 0.5;
-            resamplingFreq = (valf / 0.5) * 44100.f;
-            nextSamplingStep = (resamplingFreq + (48000.f - 44100.f)) / 48000.f;
-            resamplingFreq *= 0.5;
+            nextSamplingStep = ((valf / 0.5) * 44100.f + (48000.f - 44100.f)) / 48000.f;
         } else {
             sampleMode = SAMPLEMODE_NOTRIG;
         }
+#ifdef SAMPLE_STREAM
+        if (samplingLoop && sampleMode != SAMPLEMODE_RETRIG) {
+            // Leaving re-trigger mode stops the stream, the ring plays from its start
+            samples[samplingSlot].end = samplingLapped ? RINGLENGTH : (samplingPhase >> PHASE_FRACBITS);
+            samples[samplingSlot].isReady = 1;
+            playbackSlot = samplingSlot;
+            samplingLoop = 0;
+            isSampling = 0;
+        }
+#endif
         break;
     
     default:
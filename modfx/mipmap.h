@@ -0,0 +1,120 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: mipmap.h
+ *
+ *  Half rate copies of a recording for the notes above its root.
+ *
+ *  Each copy is the one before it through a 23 tap half-band, keeping
+ *  every other sample: copy sample j sits at source sample 2j, so a
+ *  voice reads it at half the phase and step. A voice that would step over
+ *  source samples reads the copy instead, and interpolates it at a step of
+ *  one or less without aliasing.
+ *
+ *  mipmap_run() carries on from where it left off for a budget of work
+ *  units (see jobs.h), MIPMAP_UNITS per sample written. Around a sustain loop the
+ *  source is read as the loop going round, so a copy loops as cleanly as
+ *  its source.
+ */
+
+#ifndef __mipmap_h
+#define __mipmap_h
+
+#include <stdint.h>
+
+#include "mixq15.h"
+
+#define MIPMAP_LENGTH(len) (((len) + 1) >> 1) // of the copy of len samples
+#define MIPMAP_UNITS 28 // per sample written, the 23 taps take some 290 cycles
+
+// 23 tap half-band (Kaiser, beta 6) in Q15, rounded to sum to one. Built off the
+// block path, so longer than the one the recorder runs: -30 dB at 0.31 of the rate.
+#define MIPMAP_H0 16384
+#define MIPMAP_H1 10193
+#define MIPMAP_H3 -2826
+#define MIPMAP_H5 1151
+#define MIPMAP_H7 -434
+#define MIPMAP_H9 122
+#define MIPMAP_H11 -14
+
+typedef struct {
+    const int16_t *pSrc;
+    int16_t *pDst;
+    int32_t srcLength; // read as silence from here on
+    int32_t loopEnd; // read from loopEnd - loopLength on, when loopLength is not 0
+    int32_t loopLength;
+    int32_t pos; // next sample written
+    int32_t end;
+} mipmap_t;
+
+// Starts the copy of the srcLength samples at pSrc, from around first. pDst has
+// room for MIPMAP_LENGTH(srcLength) samples and the interpolation taps around them.
+static inline void mipmap_begin(mipmap_t *p, const int16_t *pSrc, uint32_t srcLength, uint32_t first,
+                                uint32_t loopEnd, uint32_t loopLength, int16_t *pDst)
+{
+    p->pSrc = pSrc;
+    p->pDst = pDst;
+    p->srcLength = srcLength;
+    p->loopEnd = loopEnd;
+    p->loopLength = loopLength;
+    p->pos = (int32_t)(first >> 1) - MIX_TAPSBEFORE;
+    p->end = MIPMAP_LENGTH(srcLength) + MIX_TAPSAFTER;
+}
+
+static inline int32_t mipmap_read(const mipmap_t *p, int32_t k)
+{
+    if (p->loopLength && k >= p->loopEnd) {
+        k -= p->loopLength;
+    }
+    return (k < 0 || k >= p->srcLength) ? 0 : p->pSrc[k];
+}
+
+// Spends *pBudget, returns 1 while not done
+static inline uint8_t mipmap_run(mipmap_t *p, int32_t *pBudget)
+{
+    for (; p->pos < p->end && *pBudget > 0; p->pos++, *pBudget -= MIPMAP_UNITS) {
+        const int32_t k = p->pos * 2;
+        int32_t acc = MIPMAP_H0 * mipmap_read(p, k)
+            + MIPMAP_H1 * (mipmap_read(p, k - 1) + mipmap_read(p, k + 1))
+            + MIPMAP_H3 * (mipmap_read(p, k - 3) + mipmap_read(p, k + 3))
+            + MIPMAP_H5 * (mipmap_read(p, k - 5) + mipmap_read(p, k + 5))
+            + MIPMAP_H7 * (mipmap_read(p, k - 7) + mipmap_read(p, k + 7))
+            + MIPMAP_H9 * (mipmap_read(p, k - 9) + mipmap_read(p, k + 9))
+            + MIPMAP_H11 * (mipmap_read(p, k - 11) + mipmap_read(p, k + 11));
+        acc = (acc + (1L << 14)) >> 15;
+        p->pDst[p->pos] = (int16_t)(acc > 32767 ? 32767 : (acc < -32768 ? -32768 : acc));
+    }
+    return p->pos < p->end;
+}
+
+#endif // __mipmap_h
@@ -0,0 +1,324 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: mixq15.h
+ *
+ *  Fixed point playback phases and the Q15 interpolate-and-mix kernel.
+ *
+ *  Voices interpolate between adjacent int16_t samples with one dual 16-bit
+ *  multiply-add (SMUAD) and accumulate into a 32-bit mix buffer with a
+ *  linearly ramped gain (SMLAWT). The portable versions of the instructions
+ *  give bit-identical results on the host.
+ *
+ *  Two costlier interpolators share the gain stage: a 4-point Hermite and an
+ *  8 tap polyphase windowed sinc (SMLAD on sample pairs). They read up to
+ *  MIX_TAPSBEFORE samples before and MIX_TAPSAFTER after the sample index.
+ */
+
+#ifndef __mixq15_h
+#define __mixq15_h
+
+#include <stdint.h>
+#include <string.h>
+
+// Playback and record positions are unsigned fixed point phases,
+// the integer sample index above PHASE_FRACBITS and the fraction below.
+#ifndef PHASE_FRACBITS
+#define PHASE_FRACBITS 16
+#endif
+#define PHASE_ONE (1UL << PHASE_FRACBITS)
+#define PHASE_FRACMASK (PHASE_ONE - 1)
+#define k_phase_recipf (1.f / PHASE_ONE)
+
+#define MIX_COEFBITS 14 // interpolation weights, 1.0 = 16384 fits a halfword
+#define MIX_GAINBITS 30 // gain ramps, the top halfword is used as Q14
+
+#define MIX_GAINONE (1L << MIX_GAINBITS)
+#define k_mix_gainf ((float)MIX_GAINONE)
+
+// A sample at full gain lands in the mix buffer shifted up by MIX_SHIFT,
+// leaving 16 full scale voices of headroom.
+#define MIX_SHIFT (MIX_COEFBITS + (MIX_GAINBITS - 16) - 16)
+
+#define MIX_TAPSBEFORE 3
+#define MIX_TAPSAFTER 4
+
+#define MIX_SINCTAPS 8
+#define MIX_SINCPHASEBITS 4 // table branches, linearly interpolated
+#define MIX_SINCSUBBITS (PHASE_FRACBITS - MIX_SINCPHASEBITS)
+
+#if PHASE_FRACBITS < MIX_COEFBITS
+#error "PHASE_FRACBITS must hold at least MIX_COEFBITS bits of fraction"
+#endif
+
+#if defined(__ARM_FEATURE_DSP)
+
+__attribute__((always_inline)) static inline
+int32_t mix_smuad(uint32_t x, uint32_t y)
+{
+    int32_t r;
+    __asm__ ("smuad %0, %1, %2" : "=r" (r) : "r" (x), "r" (y));
+    return r;
+}
+
+__attribute__((always_inline)) static inline
+uint32_t mix_pkhbt(uint32_t bottom, uint32_t top)
+{
+    uint32_t r;
+    __asm__ ("pkhbt %0, %1, %2, lsl #16" : "=r" (r) : "r" (bottom), "r" (top));
+    return r;
+}
+
+__attribute__((always_inline)) static inline
+int32_t mix_smlawt(int32_t x, int32_t y, int32_t acc)
+{
+    int32_t r;
+    __asm__ ("smlawt %0, %1, %2, %3" : "=r" (r) : "r" (x), "r" (y), "r" (acc));
+    return r;
+}
+
+__attribute__((always_inline)) static inline
+int32_t mix_smlad(uint32_t x, uint32_t y, int32_t acc)
+{
+    int32_t r;
+    __asm__ ("smlad %0, %1, %2, %3" : "=r" (r) : "r" (x), "r" (y), "r" (acc));
+    return r;
+}
+
+__attribute__((always_inline)) static inline
+int16_t mix_ssat16(int32_t x)
+{
+    int32_t r;
+    __asm__ ("ssat %0, #16, %1" : "=r" (r) : "r" (x));
+    return (int16_t)r;
+}
+
+#else
+
+__attribute__((always_inline)) static inline
+int32_t mix_smuad(uint32_t x, uint32_t y)
+{
+    return (uint32_t)((int32_t)(int16_t)x * (int16_t)y) + (uint32_t)((int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16));
+}
+
+__attribute__((always_inline)) static inline
+uint32_t mix_pkhbt(uint32_t bottom, uint32_t top)
+{
+    return (bottom & 0xffff) | (top << 16);
+}
+
+__attribute__((always_inline)) static inline
+int32_t mix_smlawt(int32_t x, int32_t y, int32_t acc)
+{
+    return (uint32_t)acc + (uint32_t)(int32_t)(((int64_t)x * (int16_t)(y >> 16)) >> 16);
+}
+
+__attribute__((always_inline)) static inline
+int32_t mix_smlad(uint32_t x, uint32_t y, int32_t acc)
+{
+    return (uint32_t)acc + (uint32_t)mix_smuad(x, y);
+}
+
+__attribute__((always_inline)) static inline
+int16_t mix_ssat16(int32_t x)
+{
+    return (int16_t)(x > 32767 ? 32767 : (x < -32768 ? -32768 : x));
+}
+
+#endif
+
+// Samples p[0] and p[1] in the bottom and top halfword, as two halfword loads:
+// the SDRAM sits in the Cortex-M4 default device region where unaligned word
+// loads fault.
+__attribute__((always_inline)) static inline
+uint32_t mix_loadPair(const int16_t *p)
+{
+    return mix_pkhbt((uint16_t)p[0], (uint16_t)p[1]);
+}
+
+typedef uint32_t __attribute__((may_alias)) mix_word_t;
+
+// Stores count samples at p, each pair at a word aligned address as one word.
+// The SDRAM takes an aligned word in one bus access, and two for two halfwords.
+__attribute__((always_inline)) static inline
+void mix_storeSamples(int16_t *p, const int16_t *pSrc, uint32_t count)
+{
+    if (count && ((uintptr_t)p & 2)) {
+        *(p++) = *(pSrc++);
+        count--;
+    }
+    mix_word_t *pWord = (mix_word_t *)p;
+    for (; count >= 2; count -= 2, pSrc += 2) {
+        *(pWord++) = mix_pkhbt((uint16_t)pSrc[0], (uint16_t)pSrc[1]);
+    }
+    if (count) {
+        *(int16_t *)pWord = *pSrc;
+    }
+}
+
+// Copies count samples from p to pDst, which must have the same word alignment
+// as p. The SDRAM reads are aligned words, one bus access per pair.
+__attribute__((always_inline)) static inline
+void mix_loadSamples(int16_t *pDst, const int16_t *p, uint32_t count)
+{
+    if (count && ((uintptr_t)p & 2)) {
+        *(pDst++) = *(p++);
+        count--;
+    }
+    const mix_word_t *pWord = (const mix_word_t *)p;
+    mix_word_t *pDstWord = (mix_word_t *)pDst;
+    for (; count >= 2; count -= 2) {
+        *(pDstWord++) = *(pWord++);
+    }
+    if (count) {
+        *(int16_t *)pDstWord = *(const int16_t *)pWord;
+    }
+}
+
+// (a * b) >> shift with a 64-bit product (SMULL)
+__attribute__((always_inline)) static inline
+int32_t mix_mulShift(int32_t a, int32_t b, uint8_t shift)
+{
+    return (int32_t)(((int64_t)a * b) >> shift);
+}
+
+// Frames until phase reaches endPhase when advancing by step (step > 0)
+__attribute__((always_inline)) static inline
+uint32_t mix_framesUntil(uint32_t phase, uint32_t endPhase, uint32_t step)
+{
+    if (phase >= endPhase) {
+        return 0;
+    }
+    return (endPhase - phase + step - 1) / step;
+}
+
+// Interpolates frames samples from pBuf starting at phase, scales them by a gain
+// ramp (MIX_GAINBITS) and adds them to every other entry of pMix. Returns the phase
+// after the last frame.
+static inline uint32_t mixQ15(int32_t *pMix, const int16_t *pBuf, uint32_t phase, uint32_t step,
+                              int32_t gain, int32_t gainInc, uint32_t frames)
+{
+    for (; frames; frames--) {
+        const uint32_t idx = phase >> PHASE_FRACBITS;
+        const uint32_t fr = (phase & PHASE_FRACMASK) >> (PHASE_FRACBITS - MIX_COEFBITS);
+
+        const int32_t sample = mix_smuad(mix_loadPair(&pBuf[idx]), mix_pkhbt((1UL << MIX_COEFBITS) - fr, fr));
+        *pMix = mix_smlawt(sample, gain, *pMix);
+
+        pMix += 2;
+        phase += step;
+        gain += gainInc;
+    }
+    return phase;
+}
+
+// Catmull-Rom Hermite through pBuf[idx - 1] .. pBuf[idx + 2], otherwise as mixQ15
+static inline uint32_t mixHermite(int32_t *pMix, const int16_t *pBuf, uint32_t phase, uint32_t step,
+                                  int32_t gain, int32_t gainInc, uint32_t frames)
+{
+    for (; frames; frames--) {
+        const int32_t idx = phase >> PHASE_FRACBITS;
+        const int32_t t = (phase & PHASE_FRACMASK) >> (PHASE_FRACBITS - MIX_COEFBITS);
+
+        const int32_t xm1 = pBuf[idx - 1];
+        const int32_t x0 = pBuf[idx];
+        const int32_t x1 = pBuf[idx + 1];
+        const int32_t x2 = pBuf[idx + 2];
+
+        // Twice the polynomial coefficients, in sample units
+        int32_t a = (x2 - xm1) + 3 * (x0 - x1);
+        a = (xm1 + xm1 - 5 * x0 + 4 * x1 - x2) + mix_mulShift(a, t, MIX_COEFBITS);
+        a = (x1 - xm1) + mix_mulShift(a, t, MIX_COEFBITS);
+        const int32_t sample = x0 * (1 << MIX_COEFBITS) + mix_mulShift(a, t, 1);
+        *pMix = mix_smlawt(sample, gain, *pMix);
+
+        pMix += 2;
+        phase += step;
+        gain += gainInc;
+    }
+    return phase;
+}
+
+// Kaiser windowed sinc (beta 5, cutoff 0.45), taps at pBuf[idx - 3] .. pBuf[idx + 4]
+// for fractions k / 16, MIX_COEFBITS, each branch sums to one. Branch 0 is low
+// passed as well, not a unit impulse.
+static const int16_t mixSincTable[(1 << MIX_SINCPHASEBITS) + 1][MIX_SINCTAPS] __attribute__((aligned(4))) = {
+    {    322,   -842,   1389,  14646,   1389,   -842,    322,      0 },
+    {    252,   -584,    571,  14612,   2308,  -1111,    394,    -58 },
+    {    183,   -338,   -152,  14372,   3303,  -1376,    462,    -70 },
+    {    119,   -114,   -768,  13968,   4363,  -1626,    523,    -81 },
+    {     63,     85,  -1276,  13412,   5470,  -1851,    571,    -90 },
+    {     14,    253,  -1673,  12714,   6604,  -2037,    604,    -95 },
+    {    -25,    389,  -1962,  11891,   7743,  -2172,    616,    -96 },
+    {    -56,    492,  -2149,  10962,   8865,  -2243,    603,    -90 },
+    {    -77,    563,  -2239,   9945,   9945,  -2239,    563,    -77 },
+    {    -90,    603,  -2243,   8865,  10962,  -2149,    492,    -56 },
+    {    -96,    616,  -2172,   7743,  11891,  -1962,    389,    -25 },
+    {    -95,    604,  -2037,   6604,  12714,  -1673,    253,     14 },
+    {    -90,    571,  -1851,   5470,  13412,  -1276,     85,     63 },
+    {    -81,    523,  -1626,   4363,  13968,   -768,   -114,    119 },
+    {    -70,    462,  -1376,   3303,  14372,   -152,   -338,    183 },
+    {    -58,    394,  -1111,   2308,  14612,    571,   -584,    252 },
+    {      0,    322,   -842,   1389,  14646,   1389,   -842,    322 },
+};
+
+// Polyphase sinc, the two table branches around the fraction are applied to the
+// same four sample pairs and interpolated, otherwise as mixQ15
+static inline uint32_t mixSinc(int32_t *pMix, const int16_t *pBuf, uint32_t phase, uint32_t step,
+                               int32_t gain, int32_t gainInc, uint32_t frames)
+{
+    for (; frames; frames--) {
+        const int16_t *p = &pBuf[(int32_t)(phase >> PHASE_FRACBITS) - MIX_TAPSBEFORE];
+        const uint32_t fr = phase & PHASE_FRACMASK;
+        const int16_t *c0 = mixSincTable[fr >> MIX_SINCSUBBITS];
+
+        int32_t acc0 = 0, acc1 = 0;
+        for (uint32_t m = 0; m < MIX_SINCTAPS; m += 2) {
+            const uint32_t pair = mix_loadPair(&p[m]);
+            uint32_t coef0, coef1;
+            memcpy(&coef0, &c0[m], sizeof(coef0));
+            memcpy(&coef1, &c0[m + MIX_SINCTAPS], sizeof(coef1));
+            acc0 = mix_smlad(pair, coef0, acc0);
+            acc1 = mix_smlad(pair, coef1, acc1);
+        }
+        const int32_t sample = acc0 + mix_mulShift(acc1 - acc0, fr & ((1UL << MIX_SINCSUBBITS) - 1), MIX_SINCSUBBITS);
+        *pMix = mix_smlawt(sample, gain, *pMix);
+
+        pMix += 2;
+        phase += step;
+        gain += gainInc;
+    }
+    return phase;
+}
+
+#endif // __mixq15_h
@@ -0,0 +1,159 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: onset.h
+ *
+ *  Onset and tail marks and the level of a recording, worked out while it
+ *  is stored.
+ *
+ *  The stored samples are summed in windows of ONSET_WINDOW. The onset is
+ *  the start of the first window above the floor that is either loud or
+ *  well above the window before it, so a hit after noise or a slow swell
+ *  both find their start. After the onset, the end mark follows the last
+ *  window that is still above the tail threshold, relative to the loudest
+ *  window so far. Voices play from the onset to the end mark.
+ *
+ *  The peak is taken over every stored sample, the mean square over the
+ *  windows from the onset on, so a quiet lead-in does not lower it.
+ */
+
+#ifndef __onset_h
+#define __onset_h
+
+#include <stdint.h>
+#include <math.h>
+
+#define ONSET_WINDOWBITS 5 // 32 stored samples, 0.7 ms at 48k
+#define ONSET_WINDOW (1UL << ONSET_WINDOWBITS)
+
+// Mean squares of int16 samples
+#define ONSET_FLOOR (1UL << 15) // about -46 dBFS rms
+#define ONSET_RISEBITS 3 // 9 dB over the window before, or over the floor
+#define ONSET_TAILFLOOR (1UL << 10) // about -60 dBFS rms
+#define ONSET_TAILBITS 16 // the tail ends 48 dB below the loudest window
+
+#define ONSET_NONE 0xffffffff
+
+typedef struct {
+    uint32_t acc; // sum of squares >> ONSET_WINDOWBITS
+    uint32_t count; // samples in the window
+    uint32_t first; // index of the first sample in the window
+    uint32_t last; // mean square of the window before
+    uint32_t loudest;
+    uint32_t start; // onset index, ONSET_NONE until found
+    uint32_t end; // one past the last index of the tail
+    uint32_t peak; // largest magnitude
+    float energy; // sum of the window mean squares from the onset on
+    uint32_t windows;
+} onset_t;
+
+static inline void onset_reset(onset_t *p)
+{
+    p->acc = 0;
+    p->count = 0;
+    p->last = 0;
+    p->loudest = 0;
+    p->start = ONSET_NONE;
+    p->end = 0;
+    p->peak = 0;
+    p->energy = 0.f;
+    p->windows = 0;
+}
+
+// Marks a window of mean square energy ending before index end
+static inline void onset_window(onset_t *p, uint32_t energy, uint32_t end)
+{
+    if (p->start == ONSET_NONE) {
+        if (energy >= ONSET_FLOOR &&
+                ((energy >> ONSET_RISEBITS) >= p->last || energy >= (ONSET_FLOOR << ONSET_RISEBITS))) {
+            p->start = p->first;
+        }
+        p->last = energy;
+    }
+
+    if (p->start != ONSET_NONE) {
+        p->energy += (float)energy;
+        p->windows++;
+        if (energy > p->loudest) {
+            p->loudest = energy;
+        }
+        if (energy >= ONSET_TAILFLOOR && energy >= (p->loudest >> ONSET_TAILBITS)) {
+            p->end = end;
+        }
+    }
+}
+
+// Adds the sample stored at idx, indices do not go back within a recording
+static inline void onset_push(onset_t *p, int16_t sample, uint32_t idx)
+{
+    if (!p->count) {
+        p->first = idx;
+    }
+    const uint32_t magnitude = sample < 0 ? -(int32_t)sample : sample;
+    if (magnitude > p->peak) {
+        p->peak = magnitude;
+    }
+    p->acc += (uint32_t)((int32_t)sample * sample) >> ONSET_WINDOWBITS;
+    if (++p->count < ONSET_WINDOW) {
+        return;
+    }
+    onset_window(p, p->acc, idx + 1);
+    p->acc = 0;
+    p->count = 0;
+}
+
+// Closes the recording at index end (the last one written) with the partial
+// window, a recording that never rose above the floor is left empty
+static inline void onset_finish(onset_t *p, uint32_t end)
+{
+    if (p->count) {
+        onset_window(p, (uint32_t)(((uint64_t)p->acc << ONSET_WINDOWBITS) / p->count), end + 1);
+        p->acc = 0;
+        p->count = 0;
+    }
+    if (p->start == ONSET_NONE) {
+        p->start = 0;
+        p->end = 0;
+    }
+    if (p->end > end) {
+        p->end = end;
+    }
+}
+
+// Root mean square of the sound from the onset on, int16 scale
+static inline float onset_rms(const onset_t *p)
+{
+    return p->windows ? sqrtf(p->energy / (float)p->windows) : 0.f;
+}
+
+#endif // __onset_h
@@ -0,0 +1,255 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: pitch.h
+ *
+ *  Pitch of a recording, found after it is stored to key its root.
+ *
+ *  A stretch a quarter of the way into the sound is taken down to about
+ *  PITCH_RATE by averaging (the copy, in SRAM), and searched with YIN: the
+ *  squared difference of PITCH_WINDOW samples and the ones a lag later,
+ *  normalized by its mean over the shorter lags. The first dip under
+ *  PITCH_THRESHOLD (or else the deepest, if under PITCH_UNVOICED) is the
+ *  preview period. The refined period is then the smallest difference over
+ *  the same stretch at the stored rate, at the lags within one copy sample
+ *  of the preview. Both are interpolated between lags with a parabola.
+ *
+ *  pitch_run() carries on from where it left off for a budget of work
+ *  units (see jobs.h): one per sample copied or compared in the copy, and
+ *  two per sample compared in the recording. period is 0 until the preview
+ *  is found, and stays 0 for a sound without a clear pitch.
+ */
+
+#ifndef __pitch_h
+#define __pitch_h
+
+#include <stdint.h>
+
+#define PITCH_RATE 8000.f // of the copy, at most
+#define PITCH_MINFREQ 60.f
+#define PITCH_MAXFREQ 1000.f
+#define PITCH_WINDOW 128 // copy samples compared at each lag
+#define PITCH_MAXLAG 128 // in copy samples
+#define PITCH_COPY (PITCH_WINDOW + PITCH_MAXLAG + 1)
+
+#define PITCH_FLOOR (1UL << 15) // mean square of the copy, about -46 dBFS rms
+#define PITCH_THRESHOLD 0.15f
+#define PITCH_UNVOICED 0.35f
+
+#define PITCH_IDLE 0
+#define PITCH_COPYING 1
+#define PITCH_PREVIEW 2
+#define PITCH_REFINE 3
+
+typedef struct {
+    const int16_t *pBuf;
+    uint32_t first; // index of the stretch
+    uint32_t factor; // stored samples per copy sample
+    uint32_t minLag; // in copy samples during the preview, stored samples after
+    uint32_t maxLag;
+    uint32_t lag; // next one compared (or copy sample written)
+    float sum; // of the differences so far (or of the squares copied)
+    float d1; // normalized difference at lag - 1
+    float d2; // and at lag - 2
+    float best;
+    float bestLag;
+    float period; // in stored samples, 0 until found
+    uint8_t stage;
+    int16_t copy[PITCH_COPY];
+} pitch_t;
+
+// Starts looking for the pitch of the sound stored at [first, last], at rate
+static inline void pitch_begin(pitch_t *p, const int16_t *pBuf, uint32_t first, uint32_t last, float rate)
+{
+    p->stage = PITCH_IDLE;
+    p->period = 0.f;
+    p->factor = rate > PITCH_RATE ? (uint32_t)(rate * (1.f / PITCH_RATE)) : 1;
+    // The refined lags reach one copy sample past the longest
+    const uint32_t length = (PITCH_COPY + 2) * p->factor;
+    if (last < first + length) {
+        return;
+    }
+    const float copyRate = rate / (float)p->factor;
+    p->minLag = (uint32_t)(copyRate * (1.f / PITCH_MAXFREQ));
+    if (p->minLag < 2) {
+        p->minLag = 2;
+    }
+    p->maxLag = (uint32_t)(copyRate * (1.f / PITCH_MINFREQ));
+    if (p->maxLag > PITCH_MAXLAG) {
+        p->maxLag = PITCH_MAXLAG;
+    }
+    p->pBuf = pBuf;
+    p->first = first + (last - first - length) / 4;
+    p->lag = 0;
+    p->sum = 0.f;
+    p->stage = PITCH_COPYING;
+}
+
+// Vertex of the parabola through (-1, a), (0, b), (1, c)
+static inline float pitch_vertex(float a, float b, float c)
+{
+    const float den = a - 2.f * b + c;
+    return den > 0.f ? 0.5f * (a - c) / den : 0.f;
+}
+
+static inline void pitch_copy(pitch_t *p, int32_t *pBudget)
+{
+    const int16_t *pSrc = &p->pBuf[p->first + p->lag * p->factor];
+    for (; p->lag < PITCH_COPY && *pBudget > 0; p->lag++, *pBudget -= p->factor) {
+        int32_t acc = 0;
+        for (uint32_t k = 0; k < p->factor; k++) {
+            acc += *(pSrc++);
+        }
+        const int16_t sample = (int16_t)(acc / (int32_t)p->factor);
+        p->copy[p->lag] = sample;
+        p->sum += (float)sample * sample;
+    }
+    if (p->lag < PITCH_COPY) {
+        return;
+    }
+    if (p->sum < (float)PITCH_FLOOR * PITCH_COPY) {
+        // Too quiet to tell
+        p->stage = PITCH_IDLE;
+        return;
+    }
+    p->lag = 1;
+    p->sum = 0.f;
+    p->d1 = 1.f;
+    p->d2 = 1.f;
+    p->best = PITCH_UNVOICED;
+    p->bestLag = 0.f;
+    p->stage = PITCH_PREVIEW;
+}
+
+// Ends the preview at a period in copy samples, or without one
+static inline void pitch_preview(pitch_t *p, float lag)
+{
+    if (lag <= 0.f) {
+        p->stage = PITCH_IDLE;
+        return;
+    }
+    p->period = lag * (float)p->factor;
+    if (p->factor == 1) {
+        // The copy is the recording
+        p->stage = PITCH_IDLE;
+        return;
+    }
+    p->minLag = (uint32_t)p->period - p->factor;
+    p->maxLag = (uint32_t)p->period + 1 + p->factor;
+    p->lag = p->minLag;
+    p->best = 0.f;
+    p->bestLag = 0.f;
+    p->stage = PITCH_REFINE;
+}
+
+static inline void pitch_findPreview(pitch_t *p, int32_t *pBudget)
+{
+    for (; p->lag <= p->maxLag + 1 && *pBudget > 0; p->lag++, *pBudget -= PITCH_WINDOW) {
+        float diff = 0.f;
+        for (uint32_t j = 0; j < PITCH_WINDOW; j++) {
+            const float delta = (float)(p->copy[j] - p->copy[j + p->lag]);
+            diff += delta * delta;
+        }
+        p->sum += diff;
+        const float d = p->sum > 0.f ? diff * (float)p->lag / p->sum : 1.f;
+
+        // A dip at the lag before
+        const uint32_t lag = p->lag - 1;
+        if (lag >= p->minLag && p->d1 <= p->d2 && p->d1 < d) {
+            const float vertex = (float)lag + pitch_vertex(p->d2, p->d1, d);
+            if (p->d1 < PITCH_THRESHOLD) {
+                pitch_preview(p, vertex);
+                return;
+            }
+            if (p->d1 < p->best) {
+                p->best = p->d1;
+                p->bestLag = vertex;
+            }
+        }
+        p->d2 = p->d1;
+        p->d1 = d;
+    }
+    if (p->lag > p->maxLag + 1) {
+        pitch_preview(p, p->bestLag);
+    }
+}
+
+static inline void pitch_refine(pitch_t *p, int32_t *pBudget)
+{
+    const uint32_t window = PITCH_WINDOW * p->factor;
+    const int16_t *pSrc = &p->pBuf[p->first];
+    for (; p->lag <= p->maxLag && *pBudget > 0; p->lag++, *pBudget -= 2 * window) {
+        float diff = 0.f;
+        for (uint32_t j = 0; j < window; j++) {
+            const float delta = (float)(pSrc[j] - pSrc[j + p->lag]);
+            diff += delta * delta;
+        }
+        // The smallest difference away from the ends
+        if (p->lag > p->minLag + 1 && p->d1 <= p->d2 && p->d1 < diff && (p->bestLag == 0.f || p->d1 < p->best)) {
+            p->best = p->d1;
+            p->bestLag = (float)(p->lag - 1) + pitch_vertex(p->d2, p->d1, diff);
+        }
+        p->d2 = p->d1;
+        p->d1 = diff;
+    }
+    if (p->lag > p->maxLag) {
+        if (p->bestLag > 0.f) {
+            p->period = p->bestLag;
+        }
+        p->stage = PITCH_IDLE;
+    }
+}
+
+// Carries on with the copy and the search while there is budget left,
+// returns 1 while there is more to do
+static inline uint8_t pitch_run(pitch_t *p, int32_t *pBudget)
+{
+    while (*pBudget > 0) {
+        switch (p->stage) {
+            case PITCH_COPYING:
+                pitch_copy(p, pBudget);
+                break;
+            case PITCH_PREVIEW:
+                pitch_findPreview(p, pBudget);
+                break;
+            case PITCH_REFINE:
+                pitch_refine(p, pBudget);
+                break;
+            default:
+                return 0;
+        }
+    }
+    return p->stage != PITCH_IDLE;
+}
+
+#endif // __pitch_h
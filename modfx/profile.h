@@ -0,0 +1,194 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: profile.h
+ *
+ *  Per-block statistics for a TOMMY_PROFILE build.
+ *
+ *  Each call of MODFX_PROCESS adds one record to a ring of PROFILE_BLOCKS:
+ *  the time it took, the voices left playing, the voices stolen, the notes
+ *  started and the captures started, and the time and work units of the
+ *  background jobs within it (see jobs.h). Totals since init are kept
+ *  alongside. The ring is a plain global, so a debugger (or the host tools)
+ *  can read it without help from the unit.
+ *
+ *  Time is in ticks of tickHz: DWT->CYCCNT, the core clock, on the device.
+ *  Host builds define PROFILE_HOSTCLOCK and count nanoseconds instead.
+ */
+
+#ifndef __profile_h
+#define __profile_h
+
+#include <stdint.h>
+
+#ifdef PROFILE_HOSTCLOCK
+#include <chrono>
+#endif
+
+#ifndef PROFILE_BLOCKS
+#define PROFILE_BLOCKS 32 // power of two
+#endif
+#define PROFILE_CPUHZ 180000000UL // STM32F446
+#define PROFILE_SAMPLERATE 48000
+
+typedef struct {
+    uint32_t ticks; // in MODFX_PROCESS
+    uint32_t jobTicks; // of those, in the background jobs
+    uint32_t jobUnits; // the work units they spent
+    uint16_t frames;
+    uint8_t voices; // active at the end of the block
+    uint8_t steals;
+    uint8_t notes; // voices started
+    uint8_t captures; // recordings started
+    uint8_t isOverrun; // ticks past the block deadline
+} profile_block_t;
+
+typedef struct {
+    profile_block_t blocks[PROFILE_BLOCKS];
+    uint32_t count; // blocks so far, the last one is at (count - 1) % PROFILE_BLOCKS
+    uint32_t tickHz;
+    uint64_t totalTicks; // average per block is totalTicks / count
+    uint32_t maxTicks;
+    uint64_t jobTicks; // ticks per unit is jobTicks / jobUnits
+    uint64_t jobUnits;
+    uint32_t maxJobTicks; // the longest slice
+    uint32_t overruns;
+    uint32_t steals;
+    uint32_t notes;
+    uint32_t captures;
+    profile_block_t current; // while a block runs
+    uint32_t start;
+} profile_t;
+
+#ifdef PROFILE_HOSTCLOCK
+static inline uint32_t profile_ticks(void)
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#define PROFILE_TICKHZ 1000000000UL
+#else
+// DWT->CYCCNT and what enables it, by address as the units see no CMSIS headers
+#define PROFILE_DEMCR (*(volatile uint32_t *)0xE000EDFC)
+#define PROFILE_DWT_CTRL (*(volatile uint32_t *)0xE0001000)
+#define PROFILE_DWT_CYCCNT (*(volatile uint32_t *)0xE0001004)
+
+static inline uint32_t profile_ticks(void)
+{
+    return PROFILE_DWT_CYCCNT;
+}
+#define PROFILE_TICKHZ PROFILE_CPUHZ
+#endif
+
+static inline void profile_reset(profile_t *p)
+{
+#ifndef PROFILE_HOSTCLOCK
+    PROFILE_DEMCR |= 1UL << 24; // TRCENA
+    PROFILE_DWT_CTRL |= 1; // CYCCNTENA
+#endif
+    p->count = 0;
+    p->tickHz = PROFILE_TICKHZ;
+    p->totalTicks = 0;
+    p->maxTicks = 0;
+    p->jobTicks = 0;
+    p->jobUnits = 0;
+    p->maxJobTicks = 0;
+    p->overruns = 0;
+    p->steals = 0;
+    p->notes = 0;
+    p->captures = 0;
+}
+
+static inline void profile_begin(profile_t *p)
+{
+    p->current.steals = 0;
+    p->current.notes = 0;
+    p->current.captures = 0;
+    p->current.jobTicks = 0;
+    p->current.jobUnits = 0;
+    p->start = profile_ticks();
+}
+
+static inline void profile_steal(profile_t *p)
+{
+    p->current.steals++;
+}
+
+static inline void profile_note(profile_t *p)
+{
+    p->current.notes++;
+}
+
+static inline void profile_capture(profile_t *p)
+{
+    p->current.captures++;
+}
+
+// A job slice of units that began at ticks start
+static inline void profile_jobs(profile_t *p, uint32_t start, int32_t units)
+{
+    const uint32_t ticks = profile_ticks() - start;
+    p->current.jobTicks += ticks;
+    p->current.jobUnits += (uint32_t)units;
+    if (units && ticks > p->maxJobTicks) {
+        p->maxJobTicks = ticks;
+    }
+}
+
+static inline void profile_end(profile_t *p, uint32_t frames, uint8_t voices)
+{
+    profile_block_t *pBlock = &p->current;
+    pBlock->ticks = profile_ticks() - p->start;
+    pBlock->frames = (uint16_t)frames;
+    pBlock->voices = voices;
+
+    // The deadline is the time the frames take to play
+    const uint64_t deadline = (uint64_t)frames * p->tickHz / PROFILE_SAMPLERATE;
+    pBlock->isOverrun = pBlock->ticks > deadline;
+
+    p->totalTicks += pBlock->ticks;
+    p->jobTicks += pBlock->jobTicks;
+    p->jobUnits += pBlock->jobUnits;
+    if (pBlock->ticks > p->maxTicks) {
+        p->maxTicks = pBlock->ticks;
+    }
+    p->overruns += pBlock->isOverrun;
+    p->steals += pBlock->steals;
+    p->notes += pBlock->notes;
+    p->captures += pBlock->captures;
+
+    p->blocks[p->count & (PROFILE_BLOCKS - 1)] = *pBlock;
+    p->count++;
+}
+
+#endif // __profile_h
@@ -4,13 +4,32 @@
 
 PROJECT = tommy
 
+# Units built from main.cpp, each with its own defines
+VARIANTS = tommy tommy_pingpong
+VARIANTDEFS_tommy =
+VARIANTDEFS_tommy_pingpong = -DSTEREO_PING_PONG # Stereo ping-pong playback/output
+
 UCSRC = 
 
 UCXXSRC = main.cpp
 
 UINCDIR =
 
+# The unit must fit the 6K of SRAM (text, data and bss, see the size printed by
+# the build), check it after enabling any of these
 UDEFS =
+#UDEFS += -DLPFILTER_DECIMATE # Half-band and polyphase decimator in place of the first order low pass
+#UDEFS += -DINTERP_SINC # 8 tap windowed sinc for notes at or below the root, in place of Hermite
+#UDEFS += -DSAMPLE_TRIM # Play from the onset to the end of the tail, at a normalised level
+#UDEFS += -DSUSTAIN_LOOP # Loop the end of each recording while the note is held
+#UDEFS += -DSAMPLE_ADPCM # 4-bit ADPCM sample buffers, about 2.2 s instead of 0.68 s
+#UDEFS += -DSAMPLE_STREAM # Re-trigger mode records around one buffer while the notes play from it
+#UDEFS += -DSAMPLE_KIT # Single trigger captures are kept side by side, each note plays the nearest root
+#UDEFS += -DSAMPLE_LONG # One single trigger sample in the whole SDRAM, about 1.36 s instead of 0.68 s
+#UDEFS += -DSAMPLE_MIPMAP # Half rate copies for clean notes above the root, samples 2/3 as long
+#UDEFS += -DPITCH_DETECT # The root of each capture is the pitch found in it, not the trigger note
+#UDEFS += -DVOICE_WINDOW # Voices copy the samples of each pass to SRAM in words and read them from there
+#UDEFS += -DTOMMY_PROFILE # Per-block statistics in a ring (tommyProfile) for a debugger to read
 
 ULIB = 
 
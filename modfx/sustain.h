@@ -0,0 +1,212 @@
+/*
+    BSD 3-Clause License
+
+    Copyright (c) 2022, Jacob Ulmert
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ *  File: sustain.h
+ *
+ *  Sustain loop of a recording, found and crossfaded after it is stored.
+ *
+ *  The loop ends at the last rising zero crossing before the end of the
+ *  sound. Its start is the rising zero crossing, SUSTAIN_MINLENGTH to
+ *  SUSTAIN_MAXLENGTH earlier, whose preceding SUSTAIN_MATCH samples
+ *  correlate best with those before the end. The SUSTAIN_XFADE samples
+ *  before the end are then faded into the ones before the start, and the
+ *  samples after the end repeat the start for the interpolation, so a voice
+ *  only has to move its phase back by the loop length at the end. The end
+ *  and the length are rounded down to multiples of SUSTAIN_ALIGN, the
+ *  crossfade hides the sample or so they move off the zero crossings.
+ *
+ *  sustain_run() carries on from where it left off for a budget of work
+ *  units (see jobs.h): two per sample scanned or crossfaded, and two per
+ *  sample for each candidate compared. The whole search is bounded by
+ *  SUSTAIN_MAXMATCHES.
+ */
+
+#ifndef __sustain_h
+#define __sustain_h
+
+#include <stdint.h>
+
+#include "mixq15.h"
+
+#define SUSTAIN_MINLENGTH 256 // at least SUSTAIN_XFADE
+#define SUSTAIN_MAXLENGTH 4096
+#define SUSTAIN_ENDSEARCH 1024 // the end is looked for within the last samples
+#define SUSTAIN_MATCH 64 // at most SUSTAIN_XFADE
+#define SUSTAIN_XFADE 256
+
+#define SUSTAIN_MAXMATCHES 64 // candidates compared at most
+
+#ifndef SUSTAIN_ALIGN
+#define SUSTAIN_ALIGN 1 // loop end and length multiples, a power of two
+#endif
+
+#define SUSTAIN_IDLE 0
+#define SUSTAIN_FINDEND 1
+#define SUSTAIN_FINDSTART 2
+#define SUSTAIN_XFADING 3
+#define SUSTAIN_READY 4
+
+typedef struct {
+    int16_t *pBuf;
+    uint32_t first; // lowest index of the sound
+    uint32_t start; // loop start, the sample after end - 1
+    uint32_t end;
+    uint32_t scan; // next index to look at, going down (or crossfaded sample)
+    uint32_t scanEnd; // lowest index to look at
+    uint32_t matches;
+    float endEnergy;
+    float bestScore;
+    uint8_t stage;
+} sustain_t;
+
+// Starts looking for a loop in the sound stored at [first, last], the indices
+// from last - MIX_TAPSAFTER on are only read by the interpolation
+static inline void sustain_begin(sustain_t *p, int16_t *pBuf, uint32_t first, uint32_t last)
+{
+    p->stage = SUSTAIN_IDLE;
+    if (last < first + SUSTAIN_MINLENGTH + SUSTAIN_XFADE + SUSTAIN_ENDSEARCH + MIX_TAPSAFTER) {
+        return;
+    }
+    p->pBuf = pBuf;
+    p->first = first;
+    p->scan = last - MIX_TAPSAFTER;
+    p->scanEnd = p->scan - SUSTAIN_ENDSEARCH;
+    p->stage = SUSTAIN_FINDEND;
+}
+
+static inline uint8_t sustain_rising(const int16_t *pBuf, uint32_t idx)
+{
+    return pBuf[idx - 1] < 0 && pBuf[idx] >= 0;
+}
+
+// Sums of products of the SUSTAIN_MATCH samples before a and before b
+static inline float sustain_dot(const int16_t *pBuf, uint32_t a, uint32_t b)
+{
+    int32_t acc = 0;
+    for (uint32_t k = 1; k <= SUSTAIN_MATCH; k++) {
+        acc += ((int32_t)pBuf[a - k] * pBuf[b - k]) >> 6; // 64 products fit
+    }
+    return (float)acc;
+}
+
+static inline void sustain_findEnd(sustain_t *p, int32_t *pBudget)
+{
+    for (; p->scan > p->scanEnd && *pBudget > 0; p->scan--, *pBudget -= 2) {
+        if (sustain_rising(p->pBuf, p->scan)) {
+            p->end = p->scan & ~(uint32_t)(SUSTAIN_ALIGN - 1);
+            p->endEnergy = sustain_dot(p->pBuf, p->end, p->end);
+            p->scan = p->end - SUSTAIN_MINLENGTH;
+            p->scanEnd = p->end > p->first + SUSTAIN_XFADE + SUSTAIN_MAXLENGTH ?
+                p->end - SUSTAIN_MAXLENGTH : p->first + SUSTAIN_XFADE;
+            p->start = 0;
+            p->matches = 0;
+            p->bestScore = 0;
+            p->stage = SUSTAIN_FINDSTART;
+            return;
+        }
+    }
+    if (p->scan == p->scanEnd) {
+        // No zero crossing, nothing to loop on
+        p->stage = SUSTAIN_IDLE;
+    }
+}
+
+static inline void sustain_findStart(sustain_t *p, int32_t *pBudget)
+{
+    for (; p->scan > p->scanEnd && p->matches < SUSTAIN_MAXMATCHES && *pBudget > 0; p->scan--, *pBudget -= 2) {
+        if (!sustain_rising(p->pBuf, p->scan)) {
+            continue;
+        }
+        p->matches++;
+        *pBudget -= 2 * SUSTAIN_MATCH;
+        const uint32_t start = p->end - ((p->end - p->scan) & ~(uint32_t)(SUSTAIN_ALIGN - 1));
+        // Normalized correlation, squared with its sign (the end energy is common to all)
+        const float dot = sustain_dot(p->pBuf, start, p->end);
+        const float energy = sustain_dot(p->pBuf, start, start);
+        if (dot > 0.f && energy > 0.f && dot * dot > p->bestScore * energy) {
+            p->bestScore = dot * dot / energy;
+            p->start = start;
+        }
+    }
+    if (p->scan > p->scanEnd && p->matches < SUSTAIN_MAXMATCHES) {
+        return;
+    }
+    if (!p->start) {
+        p->stage = SUSTAIN_IDLE;
+        return;
+    }
+    p->scan = 0;
+    p->stage = SUSTAIN_XFADING;
+}
+
+static inline void sustain_xfade(sustain_t *p, int32_t *pBudget)
+{
+    int16_t *pEnd = &p->pBuf[p->end - SUSTAIN_XFADE];
+    const int16_t *pStart = &p->pBuf[p->start - SUSTAIN_XFADE];
+    for (; p->scan < SUSTAIN_XFADE && *pBudget > 0; p->scan++, *pBudget -= 2) {
+        // Reaches the samples before the start on the last one
+        const int32_t w = ((p->scan + 1) << 14) / SUSTAIN_XFADE;
+        pEnd[p->scan] = (int16_t)(pEnd[p->scan] + (((pStart[p->scan] - pEnd[p->scan]) * w) >> 14));
+    }
+    if (p->scan < SUSTAIN_XFADE) {
+        return;
+    }
+    for (uint32_t k = 0; k < MIX_TAPSAFTER; k++) {
+        p->pBuf[p->end + k] = p->pBuf[p->start + k];
+    }
+    p->stage = SUSTAIN_READY;
+}
+
+// Carries on with the search and the crossfade while there is budget left,
+// returns 1 while there is more to do
+static inline uint8_t sustain_run(sustain_t *p, int32_t *pBudget)
+{
+    while (*pBudget > 0) {
+        switch (p->stage) {
+            case SUSTAIN_FINDEND:
+                sustain_findEnd(p, pBudget);
+                break;
+            case SUSTAIN_FINDSTART:
+                sustain_findStart(p, pBudget);
+                break;
+            case SUSTAIN_XFADING:
+                sustain_xfade(p, pBudget);
+                break;
+            default:
+                return 0;
+        }
+    }
+    return p->stage != SUSTAIN_IDLE && p->stage != SUSTAIN_READY;
+}
+
+#endif // __sustain_h
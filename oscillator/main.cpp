@@ -32,32 +32,69 @@
 
 #include "userosc.h"
 
-uint32_t dutySampleCount;
-uint8_t noteOn;
+// Note-ons and note-offs are sent to the modfx as a short frame on the oscillator
+// output: a marker (+1 for a note-on, -1 for a note-off), PITCHFRAME_BITS pitch
+// bits (note << 8 | fine, msb first, +1 for a one and -1 for a zero) and a silent
+// guard sample. Only the signs matter, so the frame survives any gain on the way.
+// Must match modfx/main.cpp.
+#define PITCHFRAME_BITS 16
+#define PITCHFRAME_LENGTH (PITCHFRAME_BITS + 2)
+
+// Notes waiting for the frame before them to go out, in order
+#define NOTEQUEUE_LENGTH 4 // power of two
+#define NOTE_OFF 0x10000 // with the pitch in the low 16 bits
+
+uint32_t txNote;
+uint8_t txCount;
+uint32_t noteQueue[NOTEQUEUE_LENGTH];
+uint8_t noteQueueHead;
+uint8_t noteQueueCount;
+
+static inline void queueNote(uint32_t note)
+{
+  if (noteQueueCount == NOTEQUEUE_LENGTH) {
+    // Faster than the frames can go out, the oldest is dropped
+    noteQueueHead = (noteQueueHead + 1) & (NOTEQUEUE_LENGTH - 1);
+    noteQueueCount--;
+  }
+  noteQueue[(noteQueueHead + noteQueueCount) & (NOTEQUEUE_LENGTH - 1)] = note;
+  noteQueueCount++;
+}
 
 void OSC_INIT(uint32_t platform, uint32_t api)
 {
   (void)platform;
   (void)api;
 
-  dutySampleCount = 0;
-  noteOn = 0;
+  txCount = 0;
+  noteQueueHead = 0;
+  noteQueueCount = 0;
 }
 
 void OSC_CYCLE(const user_osc_param_t * const params, int32_t *yn, const uint32_t frames)
 {
-  if (noteOn) {
-    dutySampleCount = (uint32_t)((48000.f) / osc_notehzf((params->pitch)>>8));
-    noteOn = 0;
-  }
-
+  (void)params;
   q31_t * __restrict y = (q31_t *)yn;
   const q31_t * y_e = y + frames;
 
   for (; y != y_e; ) {
-    if (dutySampleCount) {
-       *(y++) = f32_to_q31(1);
-      dutySampleCount--;
+    if (!txCount && noteQueueCount) {
+      // A note during a frame waits for the frame to finish
+      txNote = noteQueue[noteQueueHead];
+      noteQueueHead = (noteQueueHead + 1) & (NOTEQUEUE_LENGTH - 1);
+      noteQueueCount--;
+      txCount = PITCHFRAME_LENGTH;
+    }
+
+    if (txCount) {
+      txCount--;
+      if (txCount == PITCHFRAME_LENGTH - 1) {
+        *(y++) = (txNote & NOTE_OFF) ? f32_to_q31(-1) : f32_to_q31(1);
+      } else if (txCount) {
+        *(y++) = ((txNote >> (txCount - 1)) & 1) ? f32_to_q31(1) : f32_to_q31(-1);
+      } else {
+        *(y++) = f32_to_q31(0);
+      }
     } else {
        *(y++) = f32_to_q31(0);
     }
@@ -67,14 +104,16 @@ void OSC_CYCLE(const user_osc_param_t * const params, int32_t *yn, const uint32_
 
 void OSC_NOTEON(const user_osc_param_t * const params) 
 {
-  noteOn = 1;
+  queueNote(params->pitch);
 }
 
 void OSC_NOTEOFF(const user_osc_param_t * const params)
 {
-  
+  queueNote(NOTE_OFF | params->pitch);
 }
 
 void OSC_PARAM(uint16_t index, uint16_t value)
-{ 
-}
\ No newline at end of file
+{
+  (void)index;
+  (void)value;
+}